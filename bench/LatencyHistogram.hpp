@@ -0,0 +1,76 @@
+#ifndef LATENCYHISTOGRAM_HPP
+#define LATENCYHISTOGRAM_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace bench {
+
+// Log-linear histogram in the spirit of HdrHistogram: every power of two is split in
+// 2^kSubBucketBits linear sub-buckets, giving a relative error below 1% over the whole range.
+class LatencyHistogram {
+   public:
+    LatencyHistogram() : counts_(BucketIndex(kMaxValue) + 1, 0), total_(0), max_(0) {}
+
+    void Record(uint64_t value) {
+        if (value > kMaxValue) {
+            value = kMaxValue;
+        }
+        counts_[BucketIndex(value)]++;
+        total_++;
+        max_ = std::max(max_, value);
+    }
+
+    uint64_t Count() const { return total_; }
+    uint64_t Max() const { return max_; }
+
+    // Returns the upper bound of the bucket holding the given percentile (0-100]
+    uint64_t Percentile(double percentile) const {
+        if (total_ == 0) {
+            return 0;
+        }
+        uint64_t target = static_cast<uint64_t>(percentile / 100.0 * total_ + 0.5);
+        target = std::max<uint64_t>(1, std::min(target, total_));
+
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= target) {
+                return std::min(BucketUpperBound(i), max_);
+            }
+        }
+        return max_;
+    }
+
+   private:
+    static const int kSubBucketBits = 7;
+    static const uint64_t kSubBucketCount = 1 << kSubBucketBits;
+    static const uint64_t kMaxValue = 1ull << 40;
+
+    static size_t BucketIndex(uint64_t value) {
+        if (value < 2 * kSubBucketCount) {
+            return static_cast<size_t>(value);
+        }
+        int shift = 63 - __builtin_clzll(value) - kSubBucketBits;
+        return static_cast<size_t>((shift + 1) * kSubBucketCount + (value >> shift) -
+                                   kSubBucketCount);
+    }
+
+    static uint64_t BucketUpperBound(size_t index) {
+        if (index < 2 * kSubBucketCount) {
+            return index;
+        }
+        int shift = static_cast<int>(index / kSubBucketCount) - 1;
+        uint64_t subBucket = index % kSubBucketCount + kSubBucketCount;
+        return ((subBucket + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_;
+    uint64_t max_;
+};
+
+}  // namespace bench
+
+#endif /* LATENCYHISTOGRAM_HPP */
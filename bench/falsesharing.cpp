@@ -0,0 +1,115 @@
+#include <pthread.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "MessageQueue.hpp"
+
+using namespace libmsgpass;
+
+typedef std::chrono::steady_clock Clock;
+
+// Queue with the storage and locking of MessageQueue, in two layouts that only differ in the
+// alignment of its members. With Alignment = CacheLineSize the lock and message list, and the
+// condition variable, each start on their own cache line and the queue fills whole lines, like
+// MessageQueue does. With Alignment = 1 the members are packed together, so queues allocated next
+// to each other share cache lines. Both layouts run exactly the same code.
+template <size_t Alignment>
+class BenchQueue : public CacheLineAligned {
+   public:
+    void Send(int what, int arg1, int arg2, void* obj) {
+        mutex_.lock();
+        queue_.emplace_back(what, arg1, arg2, obj);
+        mutex_.unlock();
+        cond_var_.notify_one();
+    }
+
+    template <typename Oper>
+    void Receive(Oper oper) {
+        std::unique_lock<std::mutex> lock_guard(mutex_);
+        cond_var_.wait(lock_guard, [this]() { return !queue_.empty(); });
+        Message msg = queue_.front();
+        queue_.pop_front();
+        lock_guard.unlock();
+        oper(msg.what, msg.arg1, msg.arg2, msg.obj);
+    }
+
+   private:
+    // The strictest of Alignment and the natural alignment of the member
+    static constexpr size_t AlignAs(size_t natural) {
+        return Alignment > natural ? Alignment : natural;
+    }
+
+    alignas(AlignAs(alignof(std::mutex))) std::mutex mutex_;
+    std::list<Message, PoolAllocator<Message>> queue_;
+    alignas(AlignAs(alignof(std::condition_variable))) std::condition_variable cond_var_;
+};
+
+typedef BenchQueue<1> PackedQueue;
+typedef BenchQueue<CacheLineSize> PaddedQueue;
+
+static void PinToCpu(unsigned cpu) {
+    unsigned cores = std::thread::hardware_concurrency();
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cores > 0 ? cpu % cores : 0, &cpuSet);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+}
+
+// Every pair of threads streams messages through its own queue. The queues are independent, so
+// any slowdown when they are adjacent in memory comes from false sharing.
+template <typename Queue>
+static double RunPairs(int pairs, int messages) {
+    std::unique_ptr<Queue[]> queues(new Queue[pairs]);
+    std::vector<std::thread> threads;
+
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < pairs; ++i) {
+        Queue& queue = queues[i];
+        threads.emplace_back([&queue, i, messages]() {
+            PinToCpu(2 * i);
+            for (int n = 0; n < messages; ++n) {
+                queue.Send(1, n, 0, nullptr);
+            }
+        });
+        threads.emplace_back([&queue, i, messages]() {
+            PinToCpu(2 * i + 1);
+            for (int n = 0; n < messages; ++n) {
+                queue.Receive([](int, int, int, void*) {});
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    return pairs * static_cast<double>(messages) / elapsed.count();
+}
+
+int main(int argc, char* argv[]) {
+    int pairs = argc > 1 ? std::atoi(argv[1]) : 2;
+    int messages = argc > 2 ? std::atoi(argv[2]) : 1000000;
+
+    if (pairs <= 0 || messages <= 0) {
+        std::fprintf(stderr, "usage: %s [thread pairs] [messages per pair]\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("%d producer/consumer pairs, %d messages each, %u cores\n", pairs, messages,
+                std::thread::hardware_concurrency());
+    std::printf("%-12s %8s %16s\n", "layout", "size", "msgs/s");
+    std::printf("%-12s %8zu %16.0f\n", "packed", sizeof(PackedQueue),
+                RunPairs<PackedQueue>(pairs, messages));
+    std::printf("%-12s %8zu %16.0f\n", "padded", sizeof(PaddedQueue),
+                RunPairs<PaddedQueue>(pairs, messages));
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Locks.hpp"
+#include "MessageQueue.hpp"
+#include "PoolAllocator.hpp"
+
+using namespace libmsgpass;
+
+typedef std::chrono::steady_clock Clock;
+
+// Every thread sends a message and takes one back, over and over, on a single shared queue. Each
+// operation is a short critical section, so the cost of the lock itself dominates.
+template <typename Lock>
+static double Run(int threads, int messages) {
+    BasicMessageQueue<PoolAllocator<Message>, Lock> queue;
+    std::vector<std::thread> workers;
+
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back([&queue, messages]() {
+            for (int n = 0; n < messages; ++n) {
+                queue.Send(1, n, 0, nullptr);
+                queue.TryReceive([](int, int, int, void*) {});
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    return threads * static_cast<double>(messages) / elapsed.count();
+}
+
+int main(int argc, char* argv[]) {
+    int maxThreads = argc > 1 ? std::atoi(argv[1]) : 32;
+    int messages = argc > 2 ? std::atoi(argv[2]) : 200000;
+
+    if (maxThreads <= 0 || messages <= 0) {
+        std::fprintf(stderr, "usage: %s [max threads] [messages per thread]\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("%d messages per thread, %u cores, msgs/s\n", messages,
+                std::thread::hardware_concurrency());
+    std::printf("%8s %14s %14s %14s %14s %14s\n", "threads", "std::mutex", "SpinLock",
+                "TicketLock", "McsLock", "NoLock");
+    PoolStats poolBefore = NodePool::Stats();
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        std::printf("%8d", threads);
+        std::printf(" %14.0f", Run<std::mutex>(threads, messages));
+        std::printf(" %14.0f", Run<SpinLock>(threads, messages));
+        std::printf(" %14.0f", Run<TicketLock>(threads, messages));
+        std::printf(" %14.0f", Run<McsLock>(threads, messages));
+        // Only valid without concurrency
+        if (threads == 1) {
+            std::printf(" %14.0f\n", Run<NoLock>(threads, messages));
+        } else {
+            std::printf(" %14s\n", "-");
+        }
+        std::fflush(stdout);
+    }
+    std::printf("Node pool avoided %.0f allocations per second\n",
+                NodePool::ReusedPerSecond(poolBefore, NodePool::Stats()));
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "LatencyHistogram.hpp"
+#include "MessageQueue.hpp"
+#include "NumaMessageQueue.hpp"
+#include "ShardedMessageQueue.hpp"
+
+using namespace libmsgpass;
+using bench::LatencyHistogram;
+
+typedef std::chrono::steady_clock Clock;
+
+static const int Ping = 1;
+static const int Stop = 2;
+
+enum class WaitStrategy { Block, Yield, Spin };
+
+static const char* StrategyName(WaitStrategy strategy) {
+    switch (strategy) {
+        case WaitStrategy::Block:
+            return "block";
+        case WaitStrategy::Yield:
+            return "yield";
+        case WaitStrategy::Spin:
+        default:
+            return "spin";
+    }
+}
+
+struct Options {
+    int rate;
+    int count;
+    int warmup;
+};
+
+template <typename Queue, typename Oper>
+static void WaitMessage(Queue& queue, WaitStrategy strategy, Oper oper) {
+    switch (strategy) {
+        case WaitStrategy::Block:
+            queue.Receive(oper);
+            break;
+        case WaitStrategy::Yield:
+            while (!queue.TryReceive(oper)) {
+                std::this_thread::yield();
+            }
+            break;
+        case WaitStrategy::Spin:
+            while (!queue.TryReceive(oper)) {
+            }
+            break;
+    }
+}
+
+// Server side of the ping-pong: every message is sent back to the client
+template <typename Queue>
+static void Echo(Queue& inQueue, Queue& outQueue, WaitStrategy strategy) {
+    bool running = true;
+    while (running) {
+        WaitMessage(inQueue, strategy, [&](int what, int arg1, int arg2, void* obj) {
+            if (what == Stop) {
+                running = false;
+                return;
+            }
+            outQueue.Send(what, arg1, arg2, obj);
+        });
+    }
+}
+
+// Sends one ping every 1/rate seconds and measures each round trip from the time the ping was
+// *supposed* to be sent. When a round trip stalls the client, the pings that should have gone
+// out in the meantime are charged the time they spent waiting for their turn, so the
+// percentiles are not hidden by coordinated omission.
+template <typename Queue>
+static void RunPingPong(const char* queueName, WaitStrategy strategy, const Options& options) {
+    Queue toServer;
+    Queue toClient;
+    std::thread server(Echo<Queue>, std::ref(toServer), std::ref(toClient), strategy);
+
+    LatencyHistogram histogram;
+    const std::chrono::nanoseconds period(1000000000LL / options.rate);
+    const Clock::time_point start = Clock::now();
+
+    for (int i = 0; i < options.warmup + options.count; ++i) {
+        const Clock::time_point intended = start + period * i;
+        while (Clock::now() < intended) {
+        }
+
+        toServer.Send(Ping, i, 0, nullptr);
+        WaitMessage(toClient, strategy, [](int, int, int, void*) {});
+
+        if (i >= options.warmup) {
+            auto latency = Clock::now() - intended;
+            histogram.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+        }
+    }
+
+    toServer.Send(Stop, 0, 0, nullptr);
+    server.join();
+
+    std::printf("%-16s %-6s %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n", queueName,
+                StrategyName(strategy), histogram.Percentile(50) / 1000.0,
+                histogram.Percentile(90) / 1000.0, histogram.Percentile(99) / 1000.0,
+                histogram.Percentile(99.9) / 1000.0, histogram.Percentile(99.99) / 1000.0,
+                histogram.Max() / 1000.0);
+}
+
+template <typename Queue>
+static void RunAllStrategies(const char* queueName, const Options& options) {
+    RunPingPong<Queue>(queueName, WaitStrategy::Block, options);
+    RunPingPong<Queue>(queueName, WaitStrategy::Yield, options);
+    RunPingPong<Queue>(queueName, WaitStrategy::Spin, options);
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    options.rate = argc > 1 ? std::atoi(argv[1]) : 10000;
+    options.count = argc > 2 ? std::atoi(argv[2]) : 100000;
+    options.warmup = options.count / 10;
+
+    if (options.rate <= 0 || options.count <= 0) {
+        std::fprintf(stderr, "usage: %s [rate msgs/s] [count]\n", argv[0]);
+        return 1;
+    }
+
+    std::printf("Round trip latency (us), %d msgs/s, %d samples\n", options.rate, options.count);
+    std::printf("%-16s %-6s %10s %10s %10s %10s %10s %10s\n", "queue", "wait", "p50", "p90", "p99",
+                "p99.9", "p99.99", "max");
+
+    RunAllStrategies<MessageQueue>("MessageQueue", options);
+    RunAllStrategies<ShardedMessageQueue>("Sharded", options);
+    RunAllStrategies<NumaMessageQueue>("Numa", options);
+
+    return 0;
+}
@@ -8,12 +8,10 @@ using namespace libmsgpass;
 
 static void ThreadPrinter(std::string txtOut, MessageQueue& inQueue, MessageQueue& outQueue,
                           std::ostream& os) {
-    while (1) {
-        inQueue.Receive([&](int what, int arg1, int arg2, void* obj) {
-            // Print the text and forward the message to the output queue
-            os << txtOut;
-            outQueue.Send(what, arg1, arg2, obj);
-        });
+    for (Message& msg : inQueue.Consume()) {
+        // Print the text and forward the message to the output queue
+        os << txtOut;
+        outQueue.Send(msg.what, msg.arg1, msg.arg2, msg.obj);
     }
 }
 
@@ -0,0 +1,34 @@
+#ifndef CACHELINE_HPP
+#define CACHELINE_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace libmsgpass {
+
+static const size_t CacheLineSize = 64;
+
+// Base class for types whose members are aligned to cache lines. It makes heap allocations honor
+// that alignment, which plain new only does since C++17.
+struct CacheLineAligned {
+    static void* operator new(size_t size) { return Allocate(size); }
+    static void* operator new[](size_t size) { return Allocate(size); }
+    static void* operator new(size_t, void* memory) noexcept { return memory; }
+    static void operator delete(void* memory) noexcept { std::free(memory); }
+    static void operator delete[](void* memory) noexcept { std::free(memory); }
+    static void operator delete(void*, void*) noexcept {}
+
+   private:
+    static void* Allocate(size_t size) {
+        void* memory = nullptr;
+        if (posix_memalign(&memory, CacheLineSize, size) != 0) {
+            throw std::bad_alloc();
+        }
+        return memory;
+    }
+};
+
+}  // namespace libmsgpass
+
+#endif /* CACHELINE_HPP */
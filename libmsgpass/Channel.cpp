@@ -0,0 +1,173 @@
+#include "Channel.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+
+#include "Utility.hpp"
+
+namespace libmsgpass {
+
+void ChannelWaitList::Push(ChannelWait* wait) {
+    wait->next = nullptr;
+    wait->previous = tail_;
+    if (tail_ != nullptr) {
+        tail_->next = wait;
+    } else {
+        head_ = wait;
+    }
+    tail_ = wait;
+    wait->linked = true;
+}
+
+void ChannelWaitList::Remove(ChannelWait* wait) {
+    if (wait->previous != nullptr) {
+        wait->previous->next = wait->next;
+    } else {
+        head_ = wait->next;
+    }
+    if (wait->next != nullptr) {
+        wait->next->previous = wait->previous;
+    } else {
+        tail_ = wait->previous;
+    }
+    wait->linked = false;
+}
+
+ChannelWait* ChannelWaitList::PopClaimed() {
+    while (head_ != nullptr) {
+        ChannelWait* wait = head_;
+        Remove(wait);
+        if (wait->waiter->Claim(wait->index)) {
+            return wait;
+        }
+    }
+    return nullptr;
+}
+
+void ChannelBase::CloseLocked() {
+    closed_ = true;
+    ChannelWait* wait;
+    while ((wait = receivers_.PopClaimed()) != nullptr) {
+        *wait->ok = false;
+        wait->waiter->Wake();
+    }
+    while ((wait = senders_.PopClaimed()) != nullptr) {
+        *wait->ok = false;
+        wait->waiter->Wake();
+    }
+}
+
+void SelectCase::Park(ChannelWait& wait, ChannelWaiter& waiter, int index) {
+    wait.waiter = &waiter;
+    wait.index = index;
+    wait.value = Element();
+    wait.ok = &ok_;
+    (sending_ ? channel_->senders_ : channel_->receivers_).Push(&wait);
+}
+
+void SelectCase::Unpark(ChannelWait& wait) {
+    if (wait.linked) {
+        (sending_ ? channel_->senders_ : channel_->receivers_).Remove(&wait);
+    }
+}
+
+namespace {
+
+// Locks the channels of all the cases in address order, so that selects over the same channels
+// never deadlock. A channel used by several cases is only locked once.
+class SelectLock {
+   public:
+    SelectLock(std::mutex** mutexes, int count) : mutexes_(mutexes), count_(count) {
+        std::sort(mutexes_, mutexes_ + count_);
+        count_ = static_cast<int>(std::unique(mutexes_, mutexes_ + count_) - mutexes_);
+        Lock();
+    }
+    SelectLock(const SelectLock&) = delete;
+    ~SelectLock() {
+        if (locked_) {
+            Unlock();
+        }
+    }
+
+    void Lock() {
+        for (int i = 0; i < count_; ++i) {
+            mutexes_[i]->lock();
+        }
+        locked_ = true;
+    }
+
+    void Unlock() {
+        for (int i = count_; i > 0; --i) {
+            mutexes_[i - 1]->unlock();
+        }
+        locked_ = false;
+    }
+
+   private:
+    std::mutex** mutexes_;
+    int count_;
+    bool locked_ = false;
+};
+
+// Ready cases are tried from a random one, so that none of them is starved
+int StartingCase(int count) {
+    return static_cast<int>(ThreadRandom() % static_cast<uint32_t>(count));
+}
+
+}  // namespace
+
+int SelectCases(SelectCase** cases, int count, bool block) {
+    // Plain Send and Receive have a single case, which fits in the inline storage
+    const int InlineCases = 4;
+    std::mutex* inlineMutexes[InlineCases];
+    ChannelWait inlineWaits[InlineCases];
+    std::unique_ptr<std::mutex*[]> heapMutexes;
+    std::unique_ptr<ChannelWait[]> heapWaits;
+    std::mutex** mutexes = inlineMutexes;
+    ChannelWait* waits = inlineWaits;
+    if (count > InlineCases) {
+        heapMutexes.reset(new std::mutex*[count]);
+        heapWaits.reset(new ChannelWait[count]);
+        mutexes = heapMutexes.get();
+        waits = heapWaits.get();
+    }
+
+    for (int i = 0; i < count; ++i) {
+        mutexes[i] = &cases[i]->channel_->mutex_;
+    }
+    SelectLock lock(mutexes, count);
+
+    int start = count > 1 ? StartingCase(count) : 0;
+    for (int n = 0; n < count; ++n) {
+        int i = (start + n) % count;
+        if (cases[i]->TryLocked()) {
+            lock.Unlock();
+            cases[i]->Done();
+            return i;
+        }
+    }
+    if (!block) {
+        return -1;
+    }
+
+    ChannelWaiter waiter;
+    for (int i = 0; i < count; ++i) {
+        cases[i]->Park(waits[i], waiter, i);
+    }
+    lock.Unlock();
+    waiter.Wait();
+
+    // The case that woke us up was completed and unlinked by the other side
+    lock.Lock();
+    for (int i = 0; i < count; ++i) {
+        cases[i]->Unpark(waits[i]);
+    }
+    lock.Unlock();
+
+    int selected = waiter.Selected();
+    cases[selected]->Done();
+    return selected;
+}
+
+}  // namespace libmsgpass
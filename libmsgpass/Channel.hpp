@@ -0,0 +1,320 @@
+#ifndef CHANNEL_HPP
+#define CHANNEL_HPP
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <utility>
+
+#include "CacheLine.hpp"
+#include "Parker.hpp"
+#include "PoolAllocator.hpp"
+
+namespace libmsgpass {
+
+// Thread blocked in a channel operation or a Select. Each case it waits on has a ChannelWait in
+// the channel, and the first operation to claim the waiter completes that case; the other
+// channels skip its waits from then on.
+class ChannelWaiter {
+   public:
+    ChannelWaiter() = default;
+    ChannelWaiter(const ChannelWaiter&) = delete;
+
+    // True only for the first caller, which must then complete the case and call Wake
+    bool Claim(int index) {
+        int expected = -1;
+        return selected_.compare_exchange_strong(expected, index);
+    }
+
+    int Selected() const { return selected_.load(); }
+
+    void Wake() { parker_.Wake(); }
+    void Wait() { parker_.Wait(); }
+
+   private:
+    std::atomic<int> selected_{-1};
+    Parker parker_;
+};
+
+// Case of a blocked waiter queued in a channel, like a sudog in the Go runtime. The value points
+// to the element to send, or to the variable receiving it.
+struct ChannelWait {
+    ChannelWaiter* waiter;
+    int index;
+    void* value;
+    bool* ok;
+    bool linked;
+    ChannelWait* next;
+    ChannelWait* previous;
+};
+
+// Intrusive FIFO of the waits of blocked senders or receivers
+class ChannelWaitList {
+   public:
+    void Push(ChannelWait* wait);
+    void Remove(ChannelWait* wait);
+    // Removes waits until one whose waiter can be claimed, which is returned. Waits of waiters
+    // already selected by another case are dropped.
+    ChannelWait* PopClaimed();
+
+   private:
+    ChannelWait* head_ = nullptr;
+    ChannelWait* tail_ = nullptr;
+};
+
+// Untyped part of a channel: the lock, the closed flag and the blocked waiters
+class ChannelBase : public CacheLineAligned {
+   public:
+    ChannelBase() = default;
+    ChannelBase(const ChannelBase&) = delete;
+
+   protected:
+    friend class SelectCase;
+    friend int SelectCases(class SelectCase** cases, int count, bool block);
+    template <typename T>
+    friend class ReceiveCase;
+    template <typename T>
+    friend class SendCase;
+
+    // Completes the waits of the blocked receivers and senders as failed
+    void CloseLocked();
+
+    alignas(CacheLineSize) std::mutex mutex_;
+    bool closed_ = false;
+    ChannelWaitList senders_;
+    ChannelWaitList receivers_;
+};
+
+// Send or receive operation on a channel, for Select. Made with Sending and Receiving.
+class SelectCase {
+   public:
+    // Whether the operation succeeded: false for a send on a closed channel, or a receive from a
+    // closed channel without elements left
+    bool Ok() const { return ok_; }
+
+   protected:
+    SelectCase(ChannelBase& channel, bool sending, bool* result)
+        : channel_(&channel), sending_(sending), result_(result), ok_(false) {}
+    SelectCase(const SelectCase&) = default;
+    ~SelectCase() = default;
+
+    // Completes the operation if it can proceed right away. Called with the channel locked.
+    virtual bool TryLocked() = 0;
+    // Element sent, or variable receiving it
+    virtual void* Element() = 0;
+
+   private:
+    friend int SelectCases(SelectCase** cases, int count, bool block);
+
+    void Park(ChannelWait& wait, ChannelWaiter& waiter, int index);
+    void Unpark(ChannelWait& wait);
+    void Done() {
+        if (result_ != nullptr) {
+            *result_ = ok_;
+        }
+    }
+
+    ChannelBase* channel_;
+    bool sending_;
+    bool* result_;
+
+   protected:
+    bool ok_;
+};
+
+// Performs one of the cases that can proceed, waiting for one if block is set, and returns its
+// index. Returns -1 if none can proceed and block is not set.
+int SelectCases(SelectCase** cases, int count, bool block);
+
+// Typed channel with Go semantics. With a capacity of 0 (unbuffered) a send waits for a receiver
+// to take the value, a rendezvous; otherwise up to capacity values are buffered. Once closed,
+// sends fail and receives drain the buffered values and then fail.
+//
+// Blocked senders and receivers are queued in the channel and the other side hands them the
+// value directly, so a waiter is woken up once, by the operation that completes it.
+template <typename T>
+class Channel : public ChannelBase {
+   public:
+    explicit Channel(size_t capacity = 0) : capacity_(capacity) {}
+
+    size_t Capacity() const { return capacity_; }
+
+    size_t Count() {
+        std::unique_lock<std::mutex> lock_guard(mutex_);
+        return buffer_.size();
+    }
+
+    // Returns false if the channel is closed
+    bool Send(T value);
+    // Returns false, leaving value untouched, if the channel is closed and empty
+    bool Receive(T& value);
+    // Same as Send and Receive, but return false instead of waiting
+    bool TrySend(T value);
+    bool TryReceive(T& value);
+
+    // Wakes up all the blocked senders and receivers, which fail
+    void Close() {
+        std::unique_lock<std::mutex> lock_guard(mutex_);
+        CloseLocked();
+    }
+
+   private:
+    template <typename U>
+    friend class ReceiveCase;
+    template <typename U>
+    friend class SendCase;
+
+    const size_t capacity_;
+    // Same pooled node storage as MessageQueue
+    std::list<T, PoolAllocator<T>> buffer_;
+};
+
+template <typename T>
+class ReceiveCase : public SelectCase {
+   public:
+    ReceiveCase(Channel<T>& channel, T& value, bool* result)
+        : SelectCase(channel, false, result), channel_(channel), value_(value) {}
+
+   protected:
+    void* Element() override { return &value_; }
+
+    bool TryLocked() override {
+        // A blocked sender means the buffer is full, or that there is no buffer
+        ChannelWait* sender = channel_.senders_.PopClaimed();
+        if (sender != nullptr) {
+            T& sent = *static_cast<T*>(sender->value);
+            if (channel_.buffer_.empty()) {
+                value_ = std::move(sent);
+            } else {
+                value_ = std::move(channel_.buffer_.front());
+                channel_.buffer_.pop_front();
+                channel_.buffer_.push_back(std::move(sent));
+            }
+            *sender->ok = true;
+            sender->waiter->Wake();
+            ok_ = true;
+            return true;
+        }
+        if (!channel_.buffer_.empty()) {
+            value_ = std::move(channel_.buffer_.front());
+            channel_.buffer_.pop_front();
+            ok_ = true;
+            return true;
+        }
+        if (channel_.closed_) {
+            ok_ = false;
+            return true;
+        }
+        return false;
+    }
+
+   private:
+    Channel<T>& channel_;
+    T& value_;
+};
+
+template <typename T>
+class SendCase : public SelectCase {
+   public:
+    SendCase(Channel<T>& channel, T value, bool* result)
+        : SelectCase(channel, true, result), channel_(channel), value_(std::move(value)) {}
+    SendCase(SendCase&& other)
+        : SelectCase(other), channel_(other.channel_), value_(std::move(other.value_)) {}
+
+   protected:
+    void* Element() override { return &value_; }
+
+    bool TryLocked() override {
+        if (channel_.closed_) {
+            ok_ = false;
+            return true;
+        }
+        ChannelWait* receiver = channel_.receivers_.PopClaimed();
+        if (receiver != nullptr) {
+            *static_cast<T*>(receiver->value) = std::move(value_);
+            *receiver->ok = true;
+            receiver->waiter->Wake();
+            ok_ = true;
+            return true;
+        }
+        if (channel_.buffer_.size() < channel_.capacity_) {
+            channel_.buffer_.push_back(std::move(value_));
+            ok_ = true;
+            return true;
+        }
+        return false;
+    }
+
+   private:
+    Channel<T>& channel_;
+    T value_;
+};
+
+// Cases for Select. Receiving may also report whether the channel was closed through ok.
+template <typename T>
+ReceiveCase<T> Receiving(Channel<T>& channel, T& value) {
+    return ReceiveCase<T>(channel, value, nullptr);
+}
+
+template <typename T>
+ReceiveCase<T> Receiving(Channel<T>& channel, T& value, bool& ok) {
+    return ReceiveCase<T>(channel, value, &ok);
+}
+
+template <typename T, typename U>
+SendCase<T> Sending(Channel<T>& channel, U&& value, bool& ok) {
+    return SendCase<T>(channel, T(std::forward<U>(value)), &ok);
+}
+
+template <typename T, typename U>
+SendCase<T> Sending(Channel<T>& channel, U&& value) {
+    return SendCase<T>(channel, T(std::forward<U>(value)), nullptr);
+}
+
+// Waits until one of the cases can proceed, performs it and returns its index, in the order of
+// the arguments. When several cases are ready one of them is picked at random.
+//
+//     switch (Select(Receiving(prices, price), Sending(orders, order))) { ... }
+template <typename... Cases>
+int Select(Cases&&... cases) {
+    SelectCase* list[] = {&cases...};
+    return SelectCases(list, sizeof...(Cases), true);
+}
+
+// Same as Select, but returns -1 instead of waiting when no case can proceed, like a select with
+// a default case
+template <typename... Cases>
+int TrySelect(Cases&&... cases) {
+    SelectCase* list[] = {&cases...};
+    return SelectCases(list, sizeof...(Cases), false);
+}
+
+template <typename T>
+bool Channel<T>::Send(T value) {
+    SendCase<T> operation(*this, std::move(value), nullptr);
+    Select(operation);
+    return operation.Ok();
+}
+
+template <typename T>
+bool Channel<T>::Receive(T& value) {
+    ReceiveCase<T> operation(*this, value, nullptr);
+    Select(operation);
+    return operation.Ok();
+}
+
+template <typename T>
+bool Channel<T>::TrySend(T value) {
+    SendCase<T> operation(*this, std::move(value), nullptr);
+    return TrySelect(operation) == 0 && operation.Ok();
+}
+
+template <typename T>
+bool Channel<T>::TryReceive(T& value) {
+    ReceiveCase<T> operation(*this, value, nullptr);
+    return TrySelect(operation) == 0 && operation.Ok();
+}
+
+}  // namespace libmsgpass
+
+#endif /* CHANNEL_HPP */
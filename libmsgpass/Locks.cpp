@@ -0,0 +1,87 @@
+#include "Locks.hpp"
+
+namespace libmsgpass {
+
+void McsLock::lock() {
+    Node* node = AcquireNode();
+    Node* previous = tail_.exchange(node, std::memory_order_acq_rel);
+    if (previous != nullptr) {
+        previous->next.store(node, std::memory_order_release);
+        Backoff backoff;
+        while (node->locked.load(std::memory_order_acquire)) {
+            backoff.Pause();
+        }
+    }
+    owner_ = node;
+}
+
+bool McsLock::try_lock() {
+    Node* node = AcquireNode();
+    Node* expected = nullptr;
+    if (!tail_.compare_exchange_strong(expected, node, std::memory_order_acq_rel)) {
+        ReleaseNode(node);
+        return false;
+    }
+    owner_ = node;
+    return true;
+}
+
+void McsLock::unlock() {
+    Node* node = owner_;
+    Node* next = node->next.load(std::memory_order_acquire);
+    if (next == nullptr) {
+        Node* expected = node;
+        if (tail_.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel)) {
+            ReleaseNode(node);
+            return;
+        }
+        // A waiter swapped itself in but hasn't linked its node yet
+        Backoff backoff;
+        while ((next = node->next.load(std::memory_order_acquire)) == nullptr) {
+            backoff.Pause();
+        }
+    }
+    next->locked.store(false, std::memory_order_release);
+    ReleaseNode(node);
+}
+
+namespace {
+
+// Bit i is set while node i of the thread is in use
+thread_local unsigned usedNodes = 0;
+
+}  // namespace
+
+McsLock::Node* McsLock::ThreadNodeArray() {
+    static thread_local Node nodes[ThreadNodes];
+    return nodes;
+}
+
+McsLock::Node* McsLock::AcquireNode() {
+    Node* node = nullptr;
+    for (int i = 0; i < ThreadNodes; ++i) {
+        if ((usedNodes & (1u << i)) == 0) {
+            usedNodes |= 1u << i;
+            node = &ThreadNodeArray()[i];
+            node->allocated = false;
+            break;
+        }
+    }
+    if (node == nullptr) {
+        node = new Node;
+        node->allocated = true;
+    }
+    node->next.store(nullptr, std::memory_order_relaxed);
+    node->locked.store(true, std::memory_order_relaxed);
+    return node;
+}
+
+void McsLock::ReleaseNode(Node* node) {
+    if (node->allocated) {
+        delete node;
+    } else {
+        usedNodes &= ~(1u << (node - ThreadNodeArray()));
+    }
+}
+
+}  // namespace libmsgpass
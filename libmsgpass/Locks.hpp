@@ -0,0 +1,141 @@
+#ifndef LOCKS_HPP
+#define LOCKS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "CacheLine.hpp"
+
+namespace libmsgpass {
+
+// Lock policies for BasicMessageQueue, as alternatives to std::mutex. They meet the standard
+// Lockable requirements, so they work with std::unique_lock and std::lock.
+//
+// The spinning locks never sleep in the kernel: a waiter spins for a while and then yields its
+// core, so that the holder still gets to run when there are more threads than cores.
+
+// Waits between two checks of a lock
+class Backoff {
+   public:
+    void Pause() {
+        if (spins_ < SpinTries) {
+            spins_++;
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+   private:
+    enum { SpinTries = 100 };
+
+    int spins_ = 0;
+};
+
+// Test-and-test-and-set spinlock. Waiters spin on a plain load, which stays in their cache, and
+// only try to take the lock once it looks free. Cheapest when the lock is held briefly and by few
+// threads; not fair.
+class SpinLock {
+   public:
+    SpinLock() = default;
+    SpinLock(const SpinLock&) = delete;
+
+    void lock() {
+        Backoff backoff;
+        while (!try_lock()) {
+            while (locked_.load(std::memory_order_relaxed)) {
+                backoff.Pause();
+            }
+        }
+    }
+
+    bool try_lock() {
+        return !locked_.load(std::memory_order_relaxed) &&
+               !locked_.exchange(true, std::memory_order_acquire);
+    }
+
+    void unlock() { locked_.store(false, std::memory_order_release); }
+
+   private:
+    std::atomic<bool> locked_{false};
+};
+
+// FIFO spinlock: each thread takes a ticket and waits until it is served. Fair, but every waiter
+// spins on the same counter, and a preempted waiter holds up the ones behind it.
+class TicketLock : public CacheLineAligned {
+   public:
+    TicketLock() = default;
+    TicketLock(const TicketLock&) = delete;
+
+    void lock() {
+        uint32_t ticket = next_.fetch_add(1, std::memory_order_relaxed);
+        Backoff backoff;
+        while (serving_.load(std::memory_order_acquire) != ticket) {
+            backoff.Pause();
+        }
+    }
+
+    bool try_lock() {
+        uint32_t serving = serving_.load(std::memory_order_acquire);
+        uint32_t expected = serving;
+        return next_.compare_exchange_strong(expected, serving + 1, std::memory_order_acquire);
+    }
+
+    void unlock() {
+        serving_.store(serving_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+   private:
+    alignas(CacheLineSize) std::atomic<uint32_t> next_{0};
+    alignas(CacheLineSize) std::atomic<uint32_t> serving_{0};
+};
+
+// FIFO queue lock by Mellor-Crummey and Scott. Waiters form a linked list and each one spins on
+// its own node, so a release only touches the cache line of the next waiter. Scales best of the
+// spinning locks under contention.
+//
+// The nodes come from a small per-thread set, one per MCS lock the thread holds at a time.
+class McsLock : public CacheLineAligned {
+   public:
+    McsLock() = default;
+    McsLock(const McsLock&) = delete;
+
+    void lock();
+    bool try_lock();
+    void unlock();
+
+   private:
+    struct alignas(CacheLineSize) Node : public CacheLineAligned {
+        std::atomic<Node*> next;
+        std::atomic<bool> locked;
+        // Allocated because the thread holds more than ThreadNodes locks
+        bool allocated;
+    };
+
+    enum { ThreadNodes = 8 };
+
+    static Node* ThreadNodeArray();
+    static Node* AcquireNode();
+    static void ReleaseNode(Node* node);
+
+    alignas(CacheLineSize) std::atomic<Node*> tail_{nullptr};
+    // Node of the holder, only used by the holder
+    Node* owner_ = nullptr;
+};
+
+// No locking at all, for queues only used by one thread, e.g. a thread's own event loop. Receive
+// and ReceiveIf must then only be called when a message is pending, since nothing can send one
+// while they wait.
+class NoLock {
+   public:
+    void lock() {}
+    bool try_lock() { return true; }
+    void unlock() {}
+};
+
+}  // namespace libmsgpass
+
+#endif /* LOCKS_HPP */
@@ -0,0 +1,23 @@
+#ifndef MESSAGE_HPP
+#define MESSAGE_HPP
+
+namespace libmsgpass {
+
+struct ReplySlot;
+
+struct Message {
+    int what;
+    int arg1;
+    int arg2;
+    void* obj;
+    // Where the answer goes when the message was posted with Call
+    ReplySlot* reply;
+
+    Message(int what, int arg1, int arg2, void* obj, ReplySlot* reply = nullptr)
+        : what(what), arg1(arg1), arg2(arg2), obj(obj), reply(reply) {}
+    Message() : what(0), arg1(0), arg2(0), obj(nullptr), reply(nullptr) {}
+};
+
+}  // namespace libmsgpass
+
+#endif /* MESSAGE_HPP */
@@ -0,0 +1,175 @@
+#include "MessageBacklog.hpp"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace libmsgpass {
+
+namespace {
+
+// Consumed messages are only dropped from the front of the columns once they are at least half
+// of them, so the cost of the move is amortized over the receives
+const size_t MinCompaction = 1024;
+
+struct TypeFilter {
+    const std::vector<int>& whats;
+
+    bool Match(int value) const {
+        for (int what : whats) {
+            if (value == what) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+#if defined(__AVX2__)
+    __m256i Match(__m256i values) const {
+        __m256i matches = _mm256_setzero_si256();
+        for (int what : whats) {
+            matches = _mm256_or_si256(matches, _mm256_cmpeq_epi32(values, _mm256_set1_epi32(what)));
+        }
+        return matches;
+    }
+#elif defined(__SSE2__)
+    __m128i Match(__m128i values) const {
+        __m128i matches = _mm_setzero_si128();
+        for (int what : whats) {
+            matches = _mm_or_si128(matches, _mm_cmpeq_epi32(values, _mm_set1_epi32(what)));
+        }
+        return matches;
+    }
+#endif
+};
+
+struct RangeFilter {
+    int low;
+    int high;
+
+    bool Match(int value) const { return value >= low && value <= high; }
+
+#if defined(__AVX2__)
+    __m256i Match(__m256i values) const {
+        __m256i below = _mm256_cmpgt_epi32(_mm256_set1_epi32(low), values);
+        __m256i above = _mm256_cmpgt_epi32(values, _mm256_set1_epi32(high));
+        return _mm256_andnot_si256(_mm256_or_si256(below, above), _mm256_set1_epi32(-1));
+    }
+#elif defined(__SSE2__)
+    __m128i Match(__m128i values) const {
+        __m128i below = _mm_cmplt_epi32(values, _mm_set1_epi32(low));
+        __m128i above = _mm_cmpgt_epi32(values, _mm_set1_epi32(high));
+        return _mm_andnot_si128(_mm_or_si128(below, above), _mm_set1_epi32(-1));
+    }
+#endif
+};
+
+// Sets marks[i] for the values matching the filter and returns how many matched
+template <typename Filter>
+size_t Mark(const int* values, size_t count, const Filter& filter, uint8_t* marks) {
+    size_t matched = 0;
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+        int bits = _mm256_movemask_ps(_mm256_castsi256_ps(filter.Match(block)));
+        for (int lane = 0; lane < 8; ++lane) {
+            marks[i + lane] = (bits >> lane) & 1;
+        }
+        matched += __builtin_popcount(bits);
+    }
+#elif defined(__SSE2__)
+    for (; i + 4 <= count; i += 4) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        int bits = _mm_movemask_ps(_mm_castsi128_ps(filter.Match(block)));
+        for (int lane = 0; lane < 4; ++lane) {
+            marks[i + lane] = (bits >> lane) & 1;
+        }
+        matched += __builtin_popcount(bits);
+    }
+#endif
+    for (; i < count; ++i) {
+        marks[i] = filter.Match(values[i]);
+        matched += marks[i];
+    }
+    return matched;
+}
+
+}  // namespace
+
+void MessageBacklog::Send(int what, int arg1, int arg2, void* obj) {
+    mutex_.lock();
+    what_.push_back(what);
+    arg1_.push_back(arg1);
+    arg2_.push_back(arg2);
+    obj_.push_back(obj);
+    mutex_.unlock();
+    cond_var_.notify_one();
+}
+
+size_t MessageBacklog::Count() const {
+    std::unique_lock<std::mutex> lock_guard(mutex_);
+    return what_.size() - head_;
+}
+
+size_t MessageBacklog::RemoveTypes(const std::vector<int>& whats) {
+    std::unique_lock<std::mutex> lock_guard(mutex_);
+    marks_.resize(what_.size() - head_);
+    return Compact(Mark(what_.data() + head_, marks_.size(), TypeFilter{whats}, marks_.data()));
+}
+
+size_t MessageBacklog::RemoveArg1Range(int low, int high) {
+    std::unique_lock<std::mutex> lock_guard(mutex_);
+    marks_.resize(arg1_.size() - head_);
+    return Compact(Mark(arg1_.data() + head_, marks_.size(), RangeFilter{low, high}, marks_.data()));
+}
+
+size_t MessageBacklog::RemoveArg2Range(int low, int high) {
+    std::unique_lock<std::mutex> lock_guard(mutex_);
+    marks_.resize(arg2_.size() - head_);
+    return Compact(Mark(arg2_.data() + head_, marks_.size(), RangeFilter{low, high}, marks_.data()));
+}
+
+Message MessageBacklog::PopFront() {
+    Message msg(what_[head_], arg1_[head_], arg2_[head_], obj_[head_]);
+    head_++;
+    if (head_ == what_.size()) {
+        what_.clear();
+        arg1_.clear();
+        arg2_.clear();
+        obj_.clear();
+        head_ = 0;
+    } else if (head_ >= MinCompaction && head_ * 2 >= what_.size()) {
+        what_.erase(what_.begin(), what_.begin() + head_);
+        arg1_.erase(arg1_.begin(), arg1_.begin() + head_);
+        arg2_.erase(arg2_.begin(), arg2_.begin() + head_);
+        obj_.erase(obj_.begin(), obj_.begin() + head_);
+        head_ = 0;
+    }
+    return msg;
+}
+
+size_t MessageBacklog::Compact(size_t removed) {
+    if (removed == 0) {
+        return 0;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < marks_.size(); ++i) {
+        if (!marks_[i]) {
+            what_[kept] = what_[head_ + i];
+            arg1_[kept] = arg1_[head_ + i];
+            arg2_[kept] = arg2_[head_ + i];
+            obj_[kept] = obj_[head_ + i];
+            kept++;
+        }
+    }
+    what_.resize(kept);
+    arg1_.resize(kept);
+    arg2_.resize(kept);
+    obj_.resize(kept);
+    head_ = 0;
+    return removed;
+}
+
+}  // namespace libmsgpass
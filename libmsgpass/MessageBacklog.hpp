@@ -0,0 +1,91 @@
+#ifndef MESSAGEBACKLOG_HPP
+#define MESSAGEBACKLOG_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "CacheLine.hpp"
+#include "Message.hpp"
+
+namespace libmsgpass {
+
+// FIFO message queue storing its messages as a struct of arrays, one contiguous column per
+// field, instead of a list of nodes. Sending and receiving are amortized O(1) like in
+// MessageQueue, but purging a large backlog streams through the columns: the built-in filters
+// compare 8 (AVX2) or 4 (SSE2) values per instruction, depending on the target the library is
+// compiled for, with a scalar fallback.
+//
+// Calls are not supported, messages carry no reply.
+class MessageBacklog : public CacheLineAligned {
+   public:
+    MessageBacklog() = default;
+    MessageBacklog(const MessageBacklog&) = delete;
+
+    void Send(int what, int arg1, int arg2, void* obj);
+    size_t Count() const;
+
+    template <typename Oper>
+    void Receive(Oper oper) {
+        std::unique_lock<std::mutex> lock_guard(mutex_);
+        cond_var_.wait(lock_guard, [this]() { return head_ < what_.size(); });
+        Message msg = PopFront();
+        lock_guard.unlock();
+        oper(msg.what, msg.arg1, msg.arg2, msg.obj);
+    }
+
+    template <typename Oper>
+    bool TryReceive(Oper oper) {
+        std::unique_lock<std::mutex> lock_guard(mutex_);
+        if (head_ == what_.size()) {
+            return false;
+        }
+        Message msg = PopFront();
+        lock_guard.unlock();
+        oper(msg.what, msg.arg1, msg.arg2, msg.obj);
+        return true;
+    }
+
+    // Removes the messages matching pred(what, arg1, arg2, obj). The predicate runs with the
+    // queue locked and must not use the queue. Returns the number of messages removed.
+    template <typename Predicate>
+    size_t RemoveIf(Predicate pred) {
+        std::unique_lock<std::mutex> lock_guard(mutex_);
+        size_t pending = what_.size() - head_;
+        marks_.resize(pending);
+        size_t removed = 0;
+        for (size_t i = 0; i < pending; ++i) {
+            size_t index = head_ + i;
+            marks_[i] = pred(what_[index], arg1_[index], arg2_[index], obj_[index]);
+            removed += marks_[i];
+        }
+        return Compact(removed);
+    }
+
+    // Built-in filters, vectorized
+    size_t RemoveTypes(const std::vector<int>& whats);
+    size_t RemoveArg1Range(int low, int high);
+    size_t RemoveArg2Range(int low, int high);
+
+   private:
+    // Removes the first message, called with the lock held
+    Message PopFront();
+    // Drops the messages marked in marks_, keeping the order of the others
+    size_t Compact(size_t removed);
+
+    // Pending messages are the ones from head_ to the end of the columns
+    alignas(CacheLineSize) mutable std::mutex mutex_;
+    std::vector<int> what_;
+    std::vector<int> arg1_;
+    std::vector<int> arg2_;
+    std::vector<void*> obj_;
+    size_t head_ = 0;
+    // Messages to remove, reused by every purge
+    std::vector<uint8_t> marks_;
+    alignas(CacheLineSize) std::condition_variable cond_var_;
+};
+
+}  // namespace libmsgpass
+
+#endif /* MESSAGEBACKLOG_HPP */
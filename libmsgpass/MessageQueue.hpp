@@ -1,26 +1,187 @@
 #ifndef MESSAGEQUEUE_HPP
 #define MESSAGEQUEUE_HPP
 
+#include <atomic>
 #include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iterator>
 #include <list>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
+
+#include "CacheLine.hpp"
+#include "Locks.hpp"
+#include "Message.hpp"
+#include "Parker.hpp"
+#include "PoolAllocator.hpp"
+#include "RangeAdapters.hpp"
+#include "ReplyPool.hpp"
 
 namespace libmsgpass {
 
-class MessageQueue {
+// Receiver blocked in Receive or suspended in AsyncReceive. Send hands messages directly to a
+// waiting receiver instead of storing them in the queue.
+class AsyncReceiver {
+   public:
+    virtual void Deliver(const Message& message) = 0;
+    // Called by Close with the queue locked. Returns true if the receiver stops waiting, which
+    // removes it from the queue.
+    virtual bool Close() { return false; }
+
+   protected:
+    ~AsyncReceiver() = default;
+
+   private:
+    template <typename Allocator, typename Lock>
+    friend class BasicMessageQueue;
+
+    AsyncReceiver* next_receiver_ = nullptr;
+};
+
+// Thread blocked in Receive. The message is written to the receiver's own slot and only that
+// thread is woken up, it doesn't need to lock the queue again to take the message.
+//
+// A closable receiver, used by Consume, is also woken up by Close, without a message.
+class ParkedReceiver final : public AsyncReceiver {
    public:
-    MessageQueue() = default;
-    MessageQueue(const MessageQueue&) = delete;
+    explicit ParkedReceiver(Message& message, bool closable = false)
+        : message_(message), closable_(closable) {}
+
+    void Deliver(const Message& message) override {
+        parker_.Wake([&]() {
+            message_ = message;
+            delivered_ = true;
+        });
+    }
+
+    bool Close() override {
+        if (!closable_) {
+            return false;
+        }
+        parker_.Wake();
+        return true;
+    }
+
+    // Returns false if woken up by Close
+    bool Wait() {
+        parker_.Wait();
+        return delivered_;
+    }
+
+   private:
+    Message& message_;
+    const bool closable_;
+    bool delivered_ = false;
+    Parker parker_;
+};
+
+// Which waiting receiver gets the next message
+enum class WakeOrder {
+    // The most recently parked one, whose cache is still warm
+    Lifo,
+    // The one that has been waiting the longest
+    Fifo
+};
+
+// Identifies a message sent with SendTracked while it is pending. The id tells apart messages
+// that reuse the node of a message already gone.
+struct MessageHandle {
+    const void* node = nullptr;
+    uint64_t id = 0;
+};
+
+// Executor resuming coroutines directly in the thread that sends the message
+struct InlineExecutor {
+    template <typename Task>
+    void Post(Task&& task) {
+        task();
+    }
+};
+
+// The allocator is used for the nodes holding the pending messages. The default one recycles the
+// nodes instead of going through the global allocator on every Send and Receive.
+//
+// The lock guards the pending messages and the receivers waiting for them. Any Lockable type
+// works: std::mutex by default, or one of the policies in Locks.hpp. The critical sections are
+// short, so a SpinLock or McsLock often costs less than a mutex. NoLock is for a queue used by a
+// single thread. Receivers block on their own condition variable, so the lock never has to
+// sleep.
+//
+// The queue starts and ends on cache line boundaries, so queues placed next to each other, e.g.
+// in an array, never share a cache line.
+template <typename Allocator = PoolAllocator<Message>, typename Lock = std::mutex>
+class BasicMessageQueue : public CacheLineAligned {
+   public:
+    BasicMessageQueue() = default;
+    explicit BasicMessageQueue(const Allocator& allocator) : queue_(allocator) {}
+    BasicMessageQueue(const BasicMessageQueue&) = delete;
+    ~BasicMessageQueue();
+
+    // Maximum number of Calls waiting for an answer at the same time
+    static const size_t ReplySlots = 64;
+    // Messages taken from the queue at once by Consume
+    static const size_t ConsumeBatch = 64;
+
+    class ConsumeRange;
+
+    // Merges an incoming message into the pending one, returning false to queue it instead
+    typedef std::function<bool(Message& pending, const Message& incoming)> Combiner;
 
     void Send(int what, int arg1, int arg2, void* obj);
-    void ClearMsgType(int what);
+    void SendLatest(int what, int arg1, int arg2, void* obj);
+    MessageHandle SendTracked(int what, int arg1, int arg2, void* obj);
+    bool Cancel(const MessageHandle& handle);
+    bool Update(const MessageHandle& handle, int arg1, int arg2, void* obj);
+    CallFuture Call(int what, int arg1, int arg2, void* obj);
+    CallFuture Flush();
+    size_t ClearMsgType(int what);
+    void SetWakeOrder(WakeOrder order);
+    void SetSpinBeforePark(size_t polls);
+    size_t ClearObject(const void* obj);
+    template <typename Predicate>
+    size_t RemoveIf(Predicate pred);
+    size_t TransferTo(BasicMessageQueue& other);
+    size_t StealHalf(BasicMessageQueue& other);
+    void SetCombiner(int what, Combiner combine);
+    void Close();
     size_t Count() const;
 
+    ConsumeRange Consume(size_t batch = ConsumeBatch);
+
     template <typename Oper>
     void Receive(Oper oper) {
         Message msg;
         Dequeue(msg);
-        oper(msg.what, msg.arg1, msg.arg2, msg.obj);
+        Process(oper, msg, 0);
+    }
+
+    // Waits for the first message matching pred(what, arg1, arg2, obj) and passes it to oper.
+    // Messages that don't match stay in the queue, in order.
+    template <typename Predicate, typename Oper>
+    void ReceiveIf(Predicate pred, Oper oper) {
+        Message msg;
+        DequeueIf(pred, msg);
+        Process(oper, msg, 0);
+    }
+
+    template <typename Oper>
+    bool TryReceive(Oper oper) {
+        Message msg;
+        if (!TryDequeue(msg)) {
+            return false;
+        }
+        Process(oper, msg, 0);
+        return true;
     }
 
     template <typename Oper>
@@ -29,9 +190,12 @@ class MessageQueue {
         bool result = false;
 
         mutex_.lock();
-        if (!queue_.empty()) {
-            result = true;
-            msg = queue_.front();
+        for (const Message& pending : queue_) {
+            if (!IsBarrier(pending)) {
+                result = true;
+                msg = pending;
+                break;
+            }
         }
         mutex_.unlock();
 
@@ -42,25 +206,1051 @@ class MessageQueue {
         return result;
     }
 
+    // Input range returned by Consume. The messages are taken from the queue in batches, under a
+    // single lock, and handed out one at a time; a new batch is only taken when the loop reaches
+    // the end of the current one. The range ends once the queue is closed and empty.
+    //
+    // A Call can be answered through Reply reply(msg) while its message is the current one, and
+    // is abandoned when the loop moves on otherwise. Leaving the loop early puts the messages
+    // taken but not reached yet back at the front of the queue, in order.
+    class ConsumeRange : public RangeAdapters<ConsumeRange> {
+       public:
+        class iterator {
+           public:
+            typedef std::input_iterator_tag iterator_category;
+            typedef Message value_type;
+            typedef Message& reference;
+            typedef Message* pointer;
+            typedef std::ptrdiff_t difference_type;
+
+            iterator() : range_(nullptr) {}
+            explicit iterator(ConsumeRange* range) : range_(range) {}
+
+            Message& operator*() const { return range_->batch_[range_->next_]; }
+            Message* operator->() const { return &**this; }
+
+            iterator& operator++() {
+                if (!range_->Advance()) {
+                    range_ = nullptr;
+                }
+                return *this;
+            }
+            void operator++(int) { ++*this; }
+
+            bool operator==(const iterator& other) const { return range_ == other.range_; }
+            bool operator!=(const iterator& other) const { return !(*this == other); }
+
+           private:
+            ConsumeRange* range_;
+        };
+
+        ConsumeRange(BasicMessageQueue& queue, size_t batch)
+            : queue_(&queue), batch_size_(batch == 0 ? 1 : batch) {}
+        ConsumeRange(ConsumeRange&& other)
+            : queue_(other.queue_),
+              batch_size_(other.batch_size_),
+              batch_(std::move(other.batch_)),
+              next_(other.next_) {
+            other.queue_ = nullptr;
+            other.batch_.clear();
+            other.next_ = 0;
+        }
+        ConsumeRange(const ConsumeRange&) = delete;
+        ~ConsumeRange() {
+            if (next_ < batch_.size()) {
+                // The current message was handed out, the ones after it were not
+                Reply abandoned(batch_[next_]);
+                queue_->Requeue(batch_.data() + next_ + 1, batch_.data() + batch_.size());
+            }
+        }
+
+        // Waits for the first message
+        iterator begin() {
+            if (next_ == batch_.size() && !Fetch()) {
+                return end();
+            }
+            return iterator(this);
+        }
+
+        iterator end() { return iterator(); }
+
+       private:
+        bool Advance() {
+            Reply abandoned(batch_[next_]);
+            return ++next_ < batch_.size() || Fetch();
+        }
+
+        bool Fetch() {
+            batch_.clear();
+            next_ = 0;
+            return queue_->DequeueBatch(batch_, batch_size_);
+        }
+
+        BasicMessageQueue* queue_;
+        size_t batch_size_;
+        std::vector<Message> batch_;
+        size_t next_ = 0;
+    };
+
+#if defined(__cpp_impl_coroutine)
+    // Awaitable returned by AsyncReceive
+    template <typename Executor>
+    class ReceiveAwaiter : public AsyncReceiver {
+       public:
+        ReceiveAwaiter(BasicMessageQueue& queue, Executor& executor)
+            : queue_(queue), executor_(executor) {}
+
+        bool await_ready() { return queue_.TryDequeue(message_); }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            handle_ = handle;
+            return queue_.SuspendReceive(this, message_);
+        }
+
+        Message await_resume() const { return message_; }
+
+        void Deliver(const Message& message) override {
+            message_ = message;
+            std::coroutine_handle<> handle = handle_;
+            executor_.Post([handle]() { handle.resume(); });
+        }
+
+       private:
+        BasicMessageQueue& queue_;
+        Executor& executor_;
+        std::coroutine_handle<> handle_;
+        Message message_;
+    };
+
+    // co_await queue.AsyncReceive(executor) suspends the coroutine until a message arrives and
+    // resumes it through executor.Post(). The executor must outlive the suspended coroutine.
+    template <typename Executor>
+    ReceiveAwaiter<Executor> AsyncReceive(Executor& executor) {
+        return ReceiveAwaiter<Executor>(*this, executor);
+    }
+
+    // Resumes the coroutine in the thread that sends the message
+    ReceiveAwaiter<InlineExecutor> AsyncReceive() {
+        static InlineExecutor executor;
+        return ReceiveAwaiter<InlineExecutor>(*this, executor);
+    }
+#endif
+
    private:
-    struct Message {
-        int what;
-        int arg1;
-        int arg2;
-        void* obj;
-
-        Message(int what, int arg1, int arg2, void* obj)
-            : what(what), arg1(arg1), arg2(arg2), obj(obj) {}
-        Message() : what(0), arg1(0), arg2(0), obj(nullptr) {}
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<Message>
+        MessageAllocator;
+    typedef typename std::list<Message, MessageAllocator>::iterator Position;
+
+    // Last message already checked by a waiting ReceiveIf, end() if none. Registered in the queue
+    // so that Erase can move it back when that message is removed.
+    class Scan {
+       public:
+        explicit Scan(BasicMessageQueue& queue)
+            : last(queue.queue_.end()), queue_(queue), next_(queue.scans_), previous_(nullptr) {
+            if (next_ != nullptr) {
+                next_->previous_ = this;
+            }
+            queue_.scans_ = this;
+        }
+        Scan(const Scan&) = delete;
+        ~Scan() {
+            if (next_ != nullptr) {
+                next_->previous_ = previous_;
+            }
+            if (previous_ != nullptr) {
+                previous_->next_ = next_;
+            } else {
+                queue_.scans_ = next_;
+            }
+        }
+
+        Position last;
+
+       private:
+        friend class BasicMessageQueue;
+
+        BasicMessageQueue& queue_;
+        Scan* next_;
+        Scan* previous_;
+    };
+
+    // Obj of the barriers queued by Flush
+    static void* FlushMarker() {
+        static char marker;
+        return &marker;
+    }
+
+    static bool IsBarrier(const Message& message) { return message.obj == FlushMarker(); }
+
+    static bool PassBarrier(Message& message) {
+        if (!IsBarrier(message)) {
+            return false;
+        }
+        Reply passed(message);
+        passed.Send(0, 0, 0, nullptr);
+        return true;
+    }
+
+    static uint64_t LatestKey(const Message& message) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(message.what)) << 32) |
+               static_cast<uint32_t>(message.arg1);
+    }
+
+    // Operations taking a fifth argument get the Reply of the message
+    template <typename Oper>
+    static auto Process(Oper& oper, Message& msg, int)
+        -> decltype(oper(msg.what, msg.arg1, msg.arg2, msg.obj, std::declval<Reply&>()), void()) {
+        Reply reply(msg);
+        oper(msg.what, msg.arg1, msg.arg2, msg.obj, reply);
+    }
+
+    template <typename Oper>
+    static void Process(Oper& oper, Message& msg, long) {
+        Reply reply(msg);
+        oper(msg.what, msg.arg1, msg.arg2, msg.obj);
+    }
+
+    // Index kept for the message by Push
+    enum class Indexing { None, Latest, Tracked };
+
+    struct Tracked {
+        Position position;
+        uint64_t id;
+    };
+
+    // Pending messages of one object, in the order they were indexed. Messages usually leave
+    // in that order, so the removed ones are skipped by moving first forward.
+    struct ObjectMessages {
+        std::vector<Position> positions;
+        size_t first = 0;
     };
 
+    // Messages handed to suspended AsyncReceive calls, delivered once the lock is released
+    typedef std::vector<std::pair<AsyncReceiver*, Message>> Deliveries;
+
+    MessageHandle Push(const Message& message, Indexing indexing = Indexing::None);
+    size_t Splice(BasicMessageQueue& from, size_t count, Deliveries& deliveries);
+    static void Deliver(Deliveries& deliveries);
+    bool Combine(const Message& message);
+    bool IsIndexed(Position position) const;
+    void IndexObject(Position position);
+    void UnindexObject(const void* obj, Position position);
+    void ObjectChanged(Position position, void* previous);
+    void Rescan();
+    void Unscan(Position position);
+    void Erase(Position position);
+    void PopFront(Message& message);
+    void PassFrontBarriers();
+    void HandOff(Deliveries& deliveries);
+    ReplyPool& Replies();
     void Dequeue(Message& message);
+    bool DequeueBatch(std::vector<Message>& batch, size_t count);
+    void Requeue(const Message* first, const Message* last);
+    void Poll(std::unique_lock<Lock>& lock_guard);
+    void WakeHelper(std::unique_lock<Lock>& lock_guard);
+    bool TryDequeue(Message& message);
+    bool PopMessage(Message& message);
+    void AddReceiver(AsyncReceiver* receiver);
+    AsyncReceiver* PopReceiver();
+    template <typename Predicate>
+    void DequeueIf(Predicate& pred, Message& message);
+    bool SuspendReceive(AsyncReceiver* receiver, Message& message);
 
-    std::list<Message> queue_;
-    std::condition_variable cond_var_;
-    mutable std::mutex mutex_;
+    // Written by every Send and Receive, always under the lock
+    alignas(CacheLineSize) mutable Lock mutex_;
+    std::list<Message, MessageAllocator> queue_;
+    // Pending messages sent with SendLatest, by what and arg1
+    std::unordered_map<uint64_t, Position> latest_;
+    // Pending messages sent with SendTracked, by node
+    std::unordered_map<const void*, Tracked> tracked_;
+    uint64_t last_handle_ = 0;
+    // Pending messages by obj, built by the first ClearObject
+    std::unordered_map<const void*, ObjectMessages> objects_;
+    bool index_objects_ = false;
+    // Set with SetCombiner, by what
+    std::unordered_map<int, Combiner> combiners_;
+    // ReceiveIf calls waiting for a match
+    Scan* scans_ = nullptr;
+    // Pending barriers queued by Flush, not counted as messages
+    size_t barriers_ = 0;
+    // Set by Close, ends the Consume ranges once the queue is empty
+    bool closed_ = false;
+    // Blocked Receive and suspended AsyncReceive calls, only present while the queue is empty or
+    // a consumer is polling it
+    AsyncReceiver* receivers_head_ = nullptr;
+    AsyncReceiver* receivers_tail_ = nullptr;
+    WakeOrder wake_order_ = WakeOrder::Lifo;
+    size_t spin_before_park_ = 0;
+    // Consumers polling before parking, and whether a message was queued for them
+    size_t spinning_ = 0;
+    std::atomic<bool> spinner_signal_{false};
+    // Waited on by ReceiveIf calls, condition_variable_any works with any lock
+    alignas(CacheLineSize) typename std::conditional<std::is_same<Lock, std::mutex>::value,
+                                                     std::condition_variable,
+                                                     std::condition_variable_any>::type cond_var_;
+    // Created by the first Call
+    std::atomic<ReplyPool*> reply_pool_{nullptr};
 };
 
+typedef BasicMessageQueue<> MessageQueue;
+
+template <typename Allocator, typename Lock>
+BasicMessageQueue<Allocator, Lock>::~BasicMessageQueue() {
+    // Calls still in the queue will never be answered
+    for (Message& msg : queue_) {
+        Reply abandoned(msg);
+    }
+
+    ReplyPool* pool = reply_pool_.load();
+    if (pool != nullptr) {
+        pool->Detach();
+    }
+}
+
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::Send(int what, int arg1, int arg2, void* obj) {
+    Push(Message(what, arg1, arg2, obj));
+}
+
+// Conflating Send: if a message with the same what and arg1 sent with SendLatest is still
+// pending, its arg2 and obj are replaced in place and it keeps its position in the queue.
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::SendLatest(int what, int arg1, int arg2, void* obj) {
+    Push(Message(what, arg1, arg2, obj), Indexing::Latest);
+}
+
+// Send returning a handle to the pending message, for Cancel and Update. The handle is empty if
+// the message was handed directly to a waiting receiver.
+template <typename Allocator, typename Lock>
+MessageHandle BasicMessageQueue<Allocator, Lock>::SendTracked(int what, int arg1, int arg2,
+                                                             void* obj) {
+    return Push(Message(what, arg1, arg2, obj), Indexing::Tracked);
+}
+
+// Removes the message if it is still pending. Returns false if it was already received or
+// removed.
+template <typename Allocator, typename Lock>
+bool BasicMessageQueue<Allocator, Lock>::Cancel(const MessageHandle& handle) {
+    std::unique_lock<Lock> lock_guard(mutex_);
+    auto tracked = tracked_.find(handle.node);
+    if (tracked == tracked_.end() || tracked->second.id != handle.id) {
+        return false;
+    }
+    Erase(tracked->second.position);
+    return true;
+}
+
+// Replaces the arguments of the message if it is still pending, keeping its position
+template <typename Allocator, typename Lock>
+bool BasicMessageQueue<Allocator, Lock>::Update(const MessageHandle& handle, int arg1, int arg2,
+                                                void* obj) {
+    std::unique_lock<Lock> lock_guard(mutex_);
+    auto tracked = tracked_.find(handle.node);
+    if (tracked == tracked_.end() || tracked->second.id != handle.id) {
+        return false;
+    }
+    Message& pending = *tracked->second.position;
+    void* previous = pending.obj;
+    pending.arg1 = arg1;
+    pending.arg2 = arg2;
+    pending.obj = obj;
+    ObjectChanged(tracked->second.position, previous);
+    Rescan();
+    bool scanning = scans_ != nullptr;
+    lock_guard.unlock();
+    if (scanning) {
+        cond_var_.notify_all();
+    }
+    return true;
+}
+
+// Posts the message like Send, with a reply slot taken from the queue pool. Blocks while
+// ReplySlots calls are already waiting for their answers.
+template <typename Allocator, typename Lock>
+CallFuture BasicMessageQueue<Allocator, Lock>::Call(int what, int arg1, int arg2, void* obj) {
+    ReplySlot* slot = Replies().Acquire();
+    Push(Message(what, arg1, arg2, obj, slot));
+    return CallFuture(slot);
+}
+
+// Queues a barrier that is passed once the consumers have received every message sent before it.
+// With a single consumer, that means the messages were also processed. The future is answered
+// when the barrier is passed, and abandoned if it is removed or the queue is destroyed first.
+// Barriers are skipped by Receive, TryReceive and AsyncReceive and never seen by the callable
+// objects, predicates or Peek. ReceiveIf passes a barrier once it reaches the front of the queue.
+template <typename Allocator, typename Lock>
+CallFuture BasicMessageQueue<Allocator, Lock>::Flush() {
+    ReplySlot* slot = Replies().Acquire();
+    Push(Message(0, 0, 0, FlushMarker(), slot));
+    return CallFuture(slot);
+}
+
+template <typename Allocator, typename Lock>
+ReplyPool& BasicMessageQueue<Allocator, Lock>::Replies() {
+    ReplyPool* pool = reply_pool_.load();
+    if (pool == nullptr) {
+        ReplyPool* created = new ReplyPool(ReplySlots);
+        if (reply_pool_.compare_exchange_strong(pool, created)) {
+            pool = created;
+        } else {
+            created->Detach();
+        }
+    }
+    return *pool;
+}
+
+template <typename Allocator, typename Lock>
+MessageHandle BasicMessageQueue<Allocator, Lock>::Push(const Message& message, Indexing indexing) {
+    std::unique_lock<Lock> lock_guard(mutex_);
+    if (receivers_head_ != nullptr && spinning_ == 0 && queue_.empty()) {
+        // Suspended receivers are done with the previous messages
+        Message barrier = message;
+        if (PassBarrier(barrier)) {
+            return MessageHandle();
+        }
+        AsyncReceiver* receiver = PopReceiver();
+        lock_guard.unlock();
+        receiver->Deliver(message);
+        return MessageHandle();
+    }
+
+    MessageHandle handle;
+    if (indexing == Indexing::Latest) {
+        auto pending = latest_.find(LatestKey(message));
+        if (pending != latest_.end()) {
+            void* previous = pending->second->obj;
+            pending->second->arg2 = message.arg2;
+            pending->second->obj = message.obj;
+            ObjectChanged(pending->second, previous);
+            Rescan();
+        } else {
+            queue_.push_back(message);
+            latest_.emplace(LatestKey(message), std::prev(queue_.end()));
+            IndexObject(std::prev(queue_.end()));
+        }
+    } else if (indexing != Indexing::None || combiners_.empty() || !Combine(message)) {
+        queue_.push_back(message);
+        barriers_ += IsBarrier(message);
+        IndexObject(std::prev(queue_.end()));
+        if (indexing == Indexing::Tracked) {
+            Position position = std::prev(queue_.end());
+            handle.node = &*position;
+            handle.id = ++last_handle_;
+            tracked_.emplace(handle.node, Tracked{position, handle.id});
+        }
+    }
+
+    if (spinning_ > 0) {
+        spinner_signal_.store(true, std::memory_order_relaxed);
+    }
+    // Older messages go first to the parked receivers, if any are left with a backlog
+    Deliveries deliveries;
+    if (receivers_head_ != nullptr && spinning_ == 0) {
+        HandOff(deliveries);
+    }
+
+    // Only ReceiveIf calls wait on the condition variable. Any of them may want the message, and
+    // a message changed in place may now match one.
+    bool scanning = scans_ != nullptr;
+    lock_guard.unlock();
+    Deliver(deliveries);
+    if (scanning) {
+        cond_var_.notify_all();
+    }
+    return handle;
+}
+
+// Only the last pending message is considered, so the order of the messages is preserved. Calls
+// are never merged since each one waits for its own answer, and neither are barriers nor messages
+// indexed by SendLatest or SendTracked, whose index the combiner could invalidate.
+template <typename Allocator, typename Lock>
+bool BasicMessageQueue<Allocator, Lock>::Combine(const Message& message) {
+    if (queue_.empty() || message.reply != nullptr) {
+        return false;
+    }
+    Position last = std::prev(queue_.end());
+    Message& pending = *last;
+    if (pending.what != message.what || pending.reply != nullptr || IsBarrier(pending) ||
+        IsIndexed(last)) {
+        return false;
+    }
+    auto combiner = combiners_.find(message.what);
+    void* previous = pending.obj;
+    if (combiner == combiners_.end() || !combiner->second(pending, message)) {
+        return false;
+    }
+    ObjectChanged(last, previous);
+    Unscan(last);
+    return true;
+}
+
+// Whether the message is indexed by SendLatest or SendTracked
+template <typename Allocator, typename Lock>
+bool BasicMessageQueue<Allocator, Lock>::IsIndexed(Position position) const {
+    if (!latest_.empty()) {
+        auto indexed = latest_.find(LatestKey(*position));
+        if (indexed != latest_.end() && indexed->second == position) {
+            return true;
+        }
+    }
+    return !tracked_.empty() && tracked_.count(&*position) > 0;
+}
+
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::IndexObject(Position position) {
+    if (index_objects_ && position->obj != nullptr) {
+        objects_[position->obj].positions.push_back(position);
+    }
+}
+
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::UnindexObject(const void* obj, Position position) {
+    auto indexed = objects_.find(obj);
+    if (indexed == objects_.end()) {
+        return;
+    }
+    ObjectMessages& messages = indexed->second;
+    if (messages.positions[messages.first] == position) {
+        messages.first++;
+    } else {
+        for (size_t i = messages.first + 1; i < messages.positions.size(); ++i) {
+            if (messages.positions[i] == position) {
+                messages.positions.erase(messages.positions.begin() + i);
+                break;
+            }
+        }
+    }
+    if (messages.first == messages.positions.size()) {
+        objects_.erase(indexed);
+    } else if (messages.first * 2 > messages.positions.size()) {
+        // An object that always has messages pending would grow the vector forever
+        messages.positions.erase(messages.positions.begin(),
+                                 messages.positions.begin() + messages.first);
+        messages.first = 0;
+    }
+}
+
+// The obj of a pending message was replaced in place
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::ObjectChanged(Position position, void* previous) {
+    if (!index_objects_ || position->obj == previous) {
+        return;
+    }
+    if (previous != nullptr) {
+        UnindexObject(previous, position);
+    }
+    IndexObject(position);
+}
+
+// Some message changed in place, the ReceiveIf calls must check all of them again
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::Rescan() {
+    for (Scan* scan = scans_; scan != nullptr; scan = scan->next_) {
+        scan->last = queue_.end();
+    }
+}
+
+// The message at position is removed or changed, the ReceiveIf calls that already checked it
+// must check it again
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::Unscan(Position position) {
+    for (Scan* scan = scans_; scan != nullptr; scan = scan->next_) {
+        if (scan->last == position) {
+            scan->last = position == queue_.begin() ? queue_.end() : std::prev(position);
+        }
+    }
+}
+
+// Every message leaving the queue goes through here, with the lock held
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::Erase(Position position) {
+    if (!latest_.empty()) {
+        auto indexed = latest_.find(LatestKey(*position));
+        if (indexed != latest_.end() && indexed->second == position) {
+            latest_.erase(indexed);
+        }
+    }
+    if (!tracked_.empty()) {
+        tracked_.erase(&*position);
+    }
+    if (index_objects_ && position->obj != nullptr) {
+        UnindexObject(position->obj, position);
+    }
+    barriers_ -= IsBarrier(*position);
+    Unscan(position);
+    queue_.erase(position);
+}
+
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::PopFront(Message& message) {
+    message = queue_.front();
+    Erase(queue_.begin());
+}
+
+// For ReceiveIf, which skips barriers: one at the front has no message left before it
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::PassFrontBarriers() {
+    while (barriers_ > 0 && IsBarrier(queue_.front())) {
+        Message barrier;
+        PopFront(barrier);
+        PassBarrier(barrier);
+    }
+}
+
+template <typename Allocator, typename Lock>
+size_t BasicMessageQueue<Allocator, Lock>::ClearMsgType(int what) {
+    return RemoveIf([what](int msgWhat, int, int, void*) { return msgWhat == what; });
+}
+
+// Moves all the pending messages to the end of the other queue, keeping their order. Both queues
+// are locked in a deadlock-free order, so two queues can transfer to each other concurrently.
+// Handles returned by SendTracked must then be used with the other queue. Returns 0 if the
+// allocators of the queues compare unequal.
+template <typename Allocator, typename Lock>
+size_t BasicMessageQueue<Allocator, Lock>::TransferTo(BasicMessageQueue& other) {
+    if (&other == this) {
+        return 0;
+    }
+    std::unique_lock<Lock> lock_guard(mutex_, std::defer_lock);
+    std::unique_lock<Lock> other_guard(other.mutex_, std::defer_lock);
+    std::lock(lock_guard, other_guard);
+    Deliveries deliveries;
+    size_t moved = other.Splice(*this, queue_.size(), deliveries);
+    lock_guard.unlock();
+    other_guard.unlock();
+
+    Deliver(deliveries);
+    if (moved > 0) {
+        other.cond_var_.notify_all();
+    }
+    return moved;
+}
+
+// Moves the newest half of the pending messages of the other queue (rounded up) to the end of
+// this one. The messages left in the other queue are the ones its consumers would get first.
+template <typename Allocator, typename Lock>
+size_t BasicMessageQueue<Allocator, Lock>::StealHalf(BasicMessageQueue& other) {
+    if (&other == this) {
+        return 0;
+    }
+    std::unique_lock<Lock> lock_guard(mutex_, std::defer_lock);
+    std::unique_lock<Lock> other_guard(other.mutex_, std::defer_lock);
+    std::lock(lock_guard, other_guard);
+    Deliveries deliveries;
+    size_t moved = Splice(other, (other.queue_.size() + 1) / 2, deliveries);
+    lock_guard.unlock();
+    other_guard.unlock();
+
+    Deliver(deliveries);
+    if (moved > 0) {
+        cond_var_.notify_all();
+    }
+    return moved;
+}
+
+// Moves the last count messages of from to the end of this queue, with both locks held. The nodes
+// are relinked, not copied: moving a whole queue without indexes in use is O(1), while moving
+// part of one is O(n) since std::list has to count the nodes moved. Nodes can only change lists
+// when the allocators compare equal, otherwise nothing is moved.
+template <typename Allocator, typename Lock>
+size_t BasicMessageQueue<Allocator, Lock>::Splice(BasicMessageQueue& from, size_t count,
+                                                  Deliveries& deliveries) {
+    if (count == 0 || queue_.get_allocator() != from.queue_.get_allocator()) {
+        return 0;
+    }
+
+    // The ReceiveIf calls on from may have checked messages that are going away
+    from.Rescan();
+    Position first;
+    if (count == from.queue_.size()) {
+        first = from.queue_.begin();
+        queue_.splice(queue_.end(), from.queue_);
+    } else {
+        first = std::prev(from.queue_.end(), count);
+        queue_.splice(queue_.end(), from.queue_, first, from.queue_.end());
+    }
+
+    if (!from.latest_.empty() || !from.tracked_.empty() || index_objects_ || from.barriers_ > 0) {
+        for (Position position = first; position != queue_.end(); ++position) {
+            if (IsBarrier(*position)) {
+                from.barriers_--;
+                barriers_++;
+            }
+            auto latest = from.latest_.find(LatestKey(*position));
+            if (latest != from.latest_.end() && latest->second == position) {
+                from.latest_.erase(latest);
+                // A message of this queue with the same key keeps being the one updated
+                latest_.emplace(LatestKey(*position), position);
+            }
+            auto tracked = from.tracked_.find(&*position);
+            if (tracked != from.tracked_.end()) {
+                tracked_.insert(*tracked);
+                from.tracked_.erase(tracked);
+            }
+            IndexObject(position);
+        }
+    }
+    if (from.index_objects_) {
+        from.objects_.clear();
+        for (Position position = from.queue_.begin(); position != from.queue_.end(); ++position) {
+            from.IndexObject(position);
+        }
+    }
+
+    HandOff(deliveries);
+    return count;
+}
+
+// Messages were added without going through Push. Waiting receivers are only registered while
+// the queue is empty, so they get the first ones.
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::HandOff(Deliveries& deliveries) {
+    while (receivers_head_ != nullptr && !queue_.empty()) {
+        Message message;
+        PopFront(message);
+        if (PassBarrier(message)) {
+            continue;
+        }
+        AsyncReceiver* receiver = PopReceiver();
+        deliveries.emplace_back(receiver, message);
+    }
+}
+
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::Deliver(Deliveries& deliveries) {
+    for (auto& delivery : deliveries) {
+        delivery.first->Deliver(delivery.second);
+    }
+}
+
+// Removes the pending messages matching pred(what, arg1, arg2, obj), abandoning the Calls among
+// them. The predicate runs with the queue locked and must not use the queue.
+template <typename Allocator, typename Lock>
+template <typename Predicate>
+size_t BasicMessageQueue<Allocator, Lock>::RemoveIf(Predicate pred) {
+    std::unique_lock<Lock> lock_guard(mutex_);
+    size_t removed = 0;
+    auto it = queue_.begin();
+    while (it != queue_.end()) {
+        if (!IsBarrier(*it) && pred(it->what, it->arg1, it->arg2, it->obj)) {
+            Reply abandoned(*it);
+            Erase(it++);
+            removed++;
+        } else {
+            ++it;
+        }
+    }
+    return removed;
+}
+
+// Removes the pending messages pointing to obj, e.g. before destroying it. The first call indexes
+// the pending messages by obj and the queue keeps the index from then on, so the next calls are
+// O(k) on the number of messages removed.
+template <typename Allocator, typename Lock>
+size_t BasicMessageQueue<Allocator, Lock>::ClearObject(const void* obj) {
+    std::unique_lock<Lock> lock_guard(mutex_);
+    if (!index_objects_) {
+        index_objects_ = true;
+        for (Position position = queue_.begin(); position != queue_.end(); ++position) {
+            IndexObject(position);
+        }
+    }
+
+    auto indexed = objects_.find(obj);
+    if (indexed == objects_.end()) {
+        return 0;
+    }
+    ObjectMessages messages = std::move(indexed->second);
+    objects_.erase(indexed);
+    for (size_t i = messages.first; i < messages.positions.size(); ++i) {
+        Reply abandoned(*messages.positions[i]);
+        Erase(messages.positions[i]);
+    }
+    return messages.positions.size() - messages.first;
+}
+
+// From then on, a Send of this what is merged by combine into the last pending message if it has
+// the same what, instead of being queued. The combiner runs with the queue locked and must not
+// use the queue. An empty combiner stops merging.
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::SetCombiner(int what, Combiner combine) {
+    std::unique_lock<Lock> lock_guard(mutex_);
+    if (combine) {
+        combiners_[what] = std::move(combine);
+    } else {
+        combiners_.erase(what);
+    }
+}
+
+// Range over the messages received from then on, in batches of up to batch messages:
+//
+//     for (Message& msg : queue.Consume()) { ... }
+template <typename Allocator, typename Lock>
+typename BasicMessageQueue<Allocator, Lock>::ConsumeRange
+BasicMessageQueue<Allocator, Lock>::Consume(size_t batch) {
+    return ConsumeRange(*this, batch);
+}
+
+// Tells the Consume ranges that no more messages are coming: they end once they have taken the
+// pending ones, and the ones waiting on an empty queue end right away. Messages can still be sent
+// and received afterwards; Receive, ReceiveIf and AsyncReceive are not affected.
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::Close() {
+    std::unique_lock<Lock> lock_guard(mutex_);
+    closed_ = true;
+    AsyncReceiver* kept = nullptr;
+    AsyncReceiver* receiver = receivers_head_;
+    receivers_head_ = nullptr;
+    while (receiver != nullptr) {
+        // A receiver may be gone as soon as it is closed
+        AsyncReceiver* next = receiver->next_receiver_;
+        if (!receiver->Close()) {
+            if (kept != nullptr) {
+                kept->next_receiver_ = receiver;
+            } else {
+                receivers_head_ = receiver;
+            }
+            kept = receiver;
+        }
+        receiver = next;
+    }
+    if (kept != nullptr) {
+        kept->next_receiver_ = nullptr;
+    }
+    receivers_tail_ = kept;
+    if (spinning_ > 0) {
+        spinner_signal_.store(true, std::memory_order_relaxed);
+    }
+}
+
+template <typename Allocator, typename Lock>
+size_t BasicMessageQueue<Allocator, Lock>::Count() const {
+    std::unique_lock<Lock> lock_guard(mutex_);
+    return queue_.size() - barriers_;
+}
+
+// Parks the thread in the receivers list when the queue is empty, so the next Send hands it its
+// message directly. With SetSpinBeforePark, polls the queue first: Send leaves its messages to
+// the polling consumer instead of waking a parked one, and a consumer that finds more messages
+// behind the one it took wakes a parked one to help.
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::Dequeue(Message& message) {
+    std::unique_lock<Lock> lock_guard(mutex_);
+    bool received = PopMessage(message);
+    if (!received && spin_before_park_ > 0) {
+        Poll(lock_guard);
+        received = PopMessage(message);
+    }
+
+    if (!received) {
+        ParkedReceiver parked(message);
+        AddReceiver(&parked);
+        lock_guard.unlock();
+        parked.Wait();
+        return;
+    }
+    WakeHelper(lock_guard);
+}
+
+// Dequeue for Consume: takes up to count messages at once. A batch stops before a barrier, which
+// is only passed by the next batch, once the consumer went through the messages sent before it.
+// It also stops before a message indexed by SendLatest or SendTracked: only the first message of
+// a batch is sure to be handed out, the others may be requeued and their index would be lost.
+// Returns false once the queue is closed and empty.
+template <typename Allocator, typename Lock>
+bool BasicMessageQueue<Allocator, Lock>::DequeueBatch(std::vector<Message>& batch, size_t count) {
+    std::unique_lock<Lock> lock_guard(mutex_);
+    bool polled = spin_before_park_ == 0;
+    while (true) {
+        while (batch.size() < count && !queue_.empty()) {
+            if (!batch.empty() && (IsBarrier(queue_.front()) || IsIndexed(queue_.begin()))) {
+                break;
+            }
+            Message message;
+            PopFront(message);
+            if (!PassBarrier(message)) {
+                batch.push_back(message);
+            }
+        }
+        if (!batch.empty()) {
+            WakeHelper(lock_guard);
+            return true;
+        }
+        if (closed_) {
+            return false;
+        }
+        if (!polled) {
+            polled = true;
+            Poll(lock_guard);
+            continue;
+        }
+
+        Message message;
+        ParkedReceiver parked(message, true);
+        AddReceiver(&parked);
+        lock_guard.unlock();
+        if (parked.Wait()) {
+            batch.push_back(message);
+            return true;
+        }
+        // Closed, but messages may have been sent since
+        lock_guard.lock();
+    }
+}
+
+// Puts back messages taken by Consume but never handed out, in front of the pending ones
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::Requeue(const Message* first, const Message* last) {
+    if (first == last) {
+        return;
+    }
+    std::unique_lock<Lock> lock_guard(mutex_);
+    Position front = queue_.begin();
+    for (; first != last; ++first) {
+        IndexObject(queue_.insert(front, *first));
+    }
+    Rescan();
+    Deliveries deliveries;
+    HandOff(deliveries);
+    if (spinning_ > 0) {
+        spinner_signal_.store(true, std::memory_order_relaxed);
+    }
+    bool scanning = scans_ != nullptr;
+    lock_guard.unlock();
+
+    Deliver(deliveries);
+    if (scanning) {
+        cond_var_.notify_all();
+    }
+}
+
+// Polls an empty queue for up to spin_before_park_ yields, until a Send signals a message
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::Poll(std::unique_lock<Lock>& lock_guard) {
+    size_t polls = spin_before_park_;
+    spinning_++;
+    lock_guard.unlock();
+    while (polls-- > 0 && !spinner_signal_.load(std::memory_order_relaxed)) {
+        std::this_thread::yield();
+    }
+    lock_guard.lock();
+    spinning_--;
+    spinner_signal_.store(false, std::memory_order_relaxed);
+}
+
+// Called after taking messages. If more are pending, e.g. a burst left to a polling consumer,
+// hands them to the parked receivers so that they help with the backlog, leaving either no
+// message or no parked receiver. Releases the lock.
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::WakeHelper(std::unique_lock<Lock>& lock_guard) {
+    Deliveries deliveries;
+    if (spinning_ == 0) {
+        HandOff(deliveries);
+    }
+    lock_guard.unlock();
+    Deliver(deliveries);
+}
+
+template <typename Allocator, typename Lock>
+bool BasicMessageQueue<Allocator, Lock>::TryDequeue(Message& message) {
+    std::unique_lock<Lock> lock_guard(mutex_);
+    return PopMessage(message);
+}
+
+// Takes the first message, passing the barriers in front of it
+template <typename Allocator, typename Lock>
+bool BasicMessageQueue<Allocator, Lock>::PopMessage(Message& message) {
+    while (!queue_.empty()) {
+        PopFront(message);
+        if (!PassBarrier(message)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::AddReceiver(AsyncReceiver* receiver) {
+    if (wake_order_ == WakeOrder::Lifo) {
+        receiver->next_receiver_ = receivers_head_;
+        receivers_head_ = receiver;
+        if (receivers_tail_ == nullptr) {
+            receivers_tail_ = receiver;
+        }
+        return;
+    }
+
+    receiver->next_receiver_ = nullptr;
+    if (receivers_tail_ != nullptr) {
+        receivers_tail_->next_receiver_ = receiver;
+    } else {
+        receivers_head_ = receiver;
+    }
+    receivers_tail_ = receiver;
+}
+
+template <typename Allocator, typename Lock>
+AsyncReceiver* BasicMessageQueue<Allocator, Lock>::PopReceiver() {
+    AsyncReceiver* receiver = receivers_head_;
+    receivers_head_ = receiver->next_receiver_;
+    if (receivers_head_ == nullptr) {
+        receivers_tail_ = nullptr;
+    }
+    return receiver;
+}
+
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::SetWakeOrder(WakeOrder order) {
+    std::unique_lock<Lock> lock_guard(mutex_);
+    wake_order_ = order;
+}
+
+// Number of times Receive polls an empty queue, yielding in between, before parking. Zero, the
+// default, parks right away.
+template <typename Allocator, typename Lock>
+void BasicMessageQueue<Allocator, Lock>::SetSpinBeforePark(size_t polls) {
+    std::unique_lock<Lock> lock_guard(mutex_);
+    spin_before_park_ = polls;
+}
+
+// Messages are only checked once: each wake-up resumes the scan after the last message checked,
+// so a waiting ReceiveIf costs O(1) per message sent rather than O(n).
+template <typename Allocator, typename Lock>
+template <typename Predicate>
+void BasicMessageQueue<Allocator, Lock>::DequeueIf(Predicate& pred, Message& message) {
+    std::unique_lock<Lock> lock_guard(mutex_);
+    Scan scan(*this);
+    Position found;
+    cond_var_.wait(lock_guard, [&]() {
+        PassFrontBarriers();
+        Position next = scan.last == queue_.end() ? queue_.begin() : std::next(scan.last);
+        for (; next != queue_.end(); scan.last = next++) {
+            if (!IsBarrier(*next) && pred(next->what, next->arg1, next->arg2, next->obj)) {
+                found = next;
+                return true;
+            }
+        }
+        return false;
+    });
+    message = *found;
+    Erase(found);
+    PassFrontBarriers();
+}
+
+// Takes the first message if there is one, otherwise registers the receiver to get the next one
+template <typename Allocator, typename Lock>
+bool BasicMessageQueue<Allocator, Lock>::SuspendReceive(AsyncReceiver* receiver, Message& message) {
+    std::unique_lock<Lock> lock_guard(mutex_);
+    if (PopMessage(message)) {
+        return false;
+    }
+    AddReceiver(receiver);
+    return true;
+}
+
+// The default queue is compiled once in the library
+extern template class BasicMessageQueue<>;
+
 }  // namespace libmsgqueue
 
 #endif /* MESSAGEQUEUE_HPP */
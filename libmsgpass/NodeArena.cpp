@@ -0,0 +1,96 @@
+#include "NodeArena.hpp"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <mutex>
+
+using namespace libmsgpass;
+
+// From <numaif.h>, which is only shipped with libnuma
+static const int MpolPreferred = 1;
+
+NodeArena::NodeArena(int nodeId)
+    : node_id_(nodeId), next_(nullptr), end_(nullptr), free_(), in_use_(0), bound_(true) {}
+
+NodeArena::~NodeArena() {
+    for (char* chunk : chunks_) {
+        munmap(chunk, ChunkSize);
+    }
+}
+
+void* NodeArena::Allocate(size_t size) {
+    size_t sizeClass = (size + Granularity - 1) / Granularity - 1;
+    std::unique_lock<SpinLock> lock_guard(lock_);
+    FreeBlock* block = free_[sizeClass];
+    if (block != nullptr) {
+        free_[sizeClass] = block->next;
+        in_use_++;
+        return block;
+    }
+
+    size_t blockSize = (sizeClass + 1) * Granularity;
+    if (static_cast<size_t>(end_ - next_) < blockSize) {
+        Grow();
+    }
+    void* memory = next_;
+    next_ += blockSize;
+    in_use_++;
+    return memory;
+}
+
+void NodeArena::Deallocate(void* memory, size_t size) {
+    size_t sizeClass = (size + Granularity - 1) / Granularity - 1;
+    std::unique_lock<SpinLock> lock_guard(lock_);
+    in_use_--;
+
+    FreeBlock* block = static_cast<FreeBlock*>(memory);
+    block->next = free_[sizeClass];
+    free_[sizeClass] = block;
+}
+
+bool NodeArena::IsBound() const {
+    std::unique_lock<SpinLock> lock_guard(lock_);
+    return bound_;
+}
+
+bool NodeArena::Owns(const void* block) const {
+    const char* address = static_cast<const char*>(block);
+    std::unique_lock<SpinLock> lock_guard(lock_);
+    for (char* chunk : chunks_) {
+        if (address >= chunk && address < chunk + ChunkSize) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t NodeArena::InUse() const {
+    std::unique_lock<SpinLock> lock_guard(lock_);
+    return in_use_;
+}
+
+bool NodeArena::BindToNode(void* memory, size_t size, int nodeId) {
+    const size_t bitsPerMask = sizeof(unsigned long) * 8;
+    size_t node = static_cast<size_t>(nodeId);
+    std::vector<unsigned long> nodeMask(node / bitsPerMask + 1, 0);
+    nodeMask[node / bitsPerMask] |= 1ul << (node % bitsPerMask);
+    return syscall(SYS_mbind, memory, size, MpolPreferred, nodeMask.data(),
+                   nodeMask.size() * bitsPerMask, 0) == 0;
+}
+
+// The rest of the last chunk is dropped, it is smaller than a block
+void NodeArena::Grow() {
+    void* memory =
+        mmap(nullptr, ChunkSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    if (!BindToNode(memory, ChunkSize, node_id_)) {
+        bound_ = false;
+    }
+    chunks_.push_back(static_cast<char*>(memory));
+    next_ = static_cast<char*>(memory);
+    end_ = next_ + ChunkSize;
+}
@@ -0,0 +1,112 @@
+#ifndef NODEARENA_HPP
+#define NODEARENA_HPP
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#include "Locks.hpp"
+
+namespace libmsgpass {
+
+// Small blocks carved from memory bound to one NUMA node, e.g. the nodes of the sub-queue of that
+// node. Memory is taken from the kernel in chunks that are placed on the node before they are
+// touched, and released blocks are kept by size for reuse. Nothing goes back to the system until
+// the arena is destroyed.
+class NodeArena {
+   public:
+    static const size_t MaxBlockSize = 256;
+
+    explicit NodeArena(int nodeId);
+    NodeArena(const NodeArena&) = delete;
+    ~NodeArena();
+
+    void* Allocate(size_t size);
+    void Deallocate(void* block, size_t size);
+
+    // Whether the kernel accepted the placement of every chunk so far
+    bool IsBound() const;
+    bool Owns(const void* block) const;
+    // Number of blocks handed out and not released yet
+    size_t InUse() const;
+
+    // Asks the kernel to place the pages on the given node, which must not be touched yet.
+    // Returns false if the placement is rejected, e.g. without NUMA support.
+    static bool BindToNode(void* memory, size_t size, int nodeId);
+
+   private:
+    static const size_t ChunkSize = 64 * 1024;
+    static const size_t Granularity = alignof(std::max_align_t);
+    static const size_t ClassCount = MaxBlockSize / Granularity;
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    void Grow();
+
+    mutable SpinLock lock_;
+    const int node_id_;
+    std::vector<char*> chunks_;
+    // Unused end of the last chunk
+    char* next_;
+    char* end_;
+    FreeBlock* free_[ClassCount];
+    size_t in_use_;
+    bool bound_;
+};
+
+// Standard allocator backed by a NodeArena. Single object allocations are served by the arena
+// and anything else goes straight to the global allocator. Allocators compare equal when they
+// share the arena.
+template <typename T>
+class NodeArenaAllocator {
+   public:
+    typedef T value_type;
+
+    explicit NodeArenaAllocator(NodeArena& arena) noexcept : arena_(&arena) {}
+    template <typename U>
+    NodeArenaAllocator(const NodeArenaAllocator<U>& other) noexcept : arena_(other.arena_) {}
+
+    T* allocate(size_t n) {
+        if (Arena(n)) {
+            return static_cast<T*>(arena_->Allocate(sizeof(T)));
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* block, size_t n) {
+        if (Arena(n)) {
+            arena_->Deallocate(block, sizeof(T));
+        } else {
+            ::operator delete(block);
+        }
+    }
+
+   private:
+    template <typename U>
+    friend class NodeArenaAllocator;
+    template <typename U, typename V>
+    friend bool operator==(const NodeArenaAllocator<U>&, const NodeArenaAllocator<V>&);
+
+    static bool Arena(size_t n) {
+        return n == 1 && sizeof(T) <= NodeArena::MaxBlockSize &&
+               alignof(T) <= alignof(std::max_align_t);
+    }
+
+    NodeArena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const NodeArenaAllocator<T>& first, const NodeArenaAllocator<U>& second) {
+    return first.arena_ == second.arena_;
+}
+
+template <typename T, typename U>
+bool operator!=(const NodeArenaAllocator<T>& first, const NodeArenaAllocator<U>& second) {
+    return !(first == second);
+}
+
+}  // namespace libmsgpass
+
+#endif /* NODEARENA_HPP */
@@ -0,0 +1,63 @@
+#include "NumaMessageQueue.hpp"
+
+#include <sys/mman.h>
+
+#include <new>
+
+using namespace libmsgpass;
+
+NumaMessageQueue::NumaMessageQueue(const NumaTopology& topology)
+    : topology_(topology) {
+    for (size_t node = 0; node < topology_.NodeCount(); ++node) {
+        bool bound = false;
+        arenas_.emplace_back(new NodeArena(topology_.NodeId(node)));
+        nodes_.push_back(AllocateOnNode(*arenas_.back(), topology_.NodeId(node), bound));
+        node_local_.push_back(bound);
+    }
+}
+
+NumaMessageQueue::~NumaMessageQueue() {
+    for (NodeQueue* queue : nodes_) {
+        Release(queue);
+    }
+}
+
+// Each sub-queue gets its own pages, placed on the requested node before they are touched, and
+// takes its message nodes from the arena of the node. If the kernel rejects the placement, e.g.
+// without NUMA support, the pages are used as is and bound is left false.
+NumaMessageQueue::NodeQueue* NumaMessageQueue::AllocateOnNode(NodeArena& arena, int nodeId,
+                                                              bool& bound) {
+    void* memory = mmap(nullptr, sizeof(NodeQueue), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    bound = NodeArena::BindToNode(memory, sizeof(NodeQueue), nodeId);
+
+    return new (memory) NodeQueue(NodeArenaAllocator<Message>(arena));
+}
+
+void NumaMessageQueue::Release(NodeQueue* queue) {
+    queue->~NodeQueue();
+    munmap(queue, sizeof(NodeQueue));
+}
+
+void NumaMessageQueue::Send(int what, int arg1, int arg2, void* obj) {
+    SendToNode(topology_.CurrentNode(), what, arg1, arg2, obj);
+}
+
+void NumaMessageQueue::SendToNode(size_t node, int what, int arg1, int arg2, void* obj) {
+    nodes_[node % nodes_.size()]->Send(what, arg1, arg2, obj);
+    pending_.Added();
+}
+
+size_t NumaMessageQueue::ClearMsgType(int what) {
+    size_t removed = 0;
+    for (NodeQueue* queue : nodes_) {
+        removed += queue->ClearMsgType(what);
+    }
+    pending_.Removed(removed);
+    return removed;
+}
+
+size_t NumaMessageQueue::Count() const { return pending_.Count(); }
@@ -0,0 +1,77 @@
+#ifndef NUMAMESSAGEQUEUE_HPP
+#define NUMAMESSAGEQUEUE_HPP
+
+#include <memory>
+#include <vector>
+
+#include "MessageQueue.hpp"
+#include "NodeArena.hpp"
+#include "NumaTopology.hpp"
+#include "PendingCounter.hpp"
+
+namespace libmsgpass {
+
+// Message queue with one sub-queue per NUMA node. Each sub-queue and its message nodes live in
+// memory local to its node, producers send to the sub-queue of the node they are running on and
+// consumers drain their local sub-queue, only stealing from remote nodes when the local one is
+// empty.
+class NumaMessageQueue : public CacheLineAligned {
+   public:
+    typedef BasicMessageQueue<NodeArenaAllocator<Message>> NodeQueue;
+
+    explicit NumaMessageQueue(const NumaTopology& topology = NumaTopology::System());
+    NumaMessageQueue(const NumaMessageQueue&) = delete;
+    ~NumaMessageQueue();
+
+    void Send(int what, int arg1, int arg2, void* obj);
+    void SendToNode(size_t node, int what, int arg1, int arg2, void* obj);
+    size_t ClearMsgType(int what);
+    size_t Count() const;
+    size_t NodeCount() const { return nodes_.size(); }
+    // Whether the sub-queue of the node and its messages could be bound to the node's memory
+    bool IsNodeLocal(size_t node) const { return node_local_[node] && arenas_[node]->IsBound(); }
+    // Memory of the messages pending in the sub-queue of the node
+    const NodeArena& Arena(size_t node) const { return *arenas_[node]; }
+    const NumaTopology& Topology() const { return topology_; }
+
+    template <typename Oper>
+    void Receive(Oper oper) {
+        while (!TryReceive(oper)) {
+            pending_.Wait();
+        }
+    }
+
+    template <typename Oper>
+    bool TryReceive(Oper oper) {
+        if (pending_.Empty()) {
+            return false;
+        }
+
+        size_t local = topology_.CurrentNode();
+        for (size_t i = 0; i < nodes_.size(); ++i) {
+            NodeQueue& queue = *nodes_[(local + i) % nodes_.size()];
+            bool received = queue.TryReceive([&](int what, int arg1, int arg2, void* obj) {
+                pending_.Removed();
+                oper(what, arg1, arg2, obj);
+            });
+            if (received) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+   private:
+    static NodeQueue* AllocateOnNode(NodeArena& arena, int nodeId, bool& bound);
+    static void Release(NodeQueue* queue);
+
+    const NumaTopology& topology_;
+    std::vector<std::unique_ptr<NodeArena>> arenas_;
+    std::vector<NodeQueue*> nodes_;
+    std::vector<bool> node_local_;
+    PendingCounter pending_;
+};
+
+}  // namespace libmsgpass
+
+#endif /* NUMAMESSAGEQUEUE_HPP */
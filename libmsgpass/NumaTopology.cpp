@@ -0,0 +1,102 @@
+#include "NumaTopology.hpp"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+#include "Utility.hpp"
+
+using namespace libmsgpass;
+
+NumaTopology::NumaTopology(const std::string& sysfsNodePath) {
+    // Node directories are named "node<N>", but their ids are not necessarily contiguous
+    std::map<int, std::vector<int>> nodes;
+    DIR* dir = opendir(sysfsNodePath.c_str());
+    if (dir != nullptr) {
+        while (dirent* entry = readdir(dir)) {
+            std::string name(entry->d_name);
+            if (name.compare(0, 4, "node") != 0 || name.size() == 4 ||
+                name.find_first_not_of("0123456789", 4) != std::string::npos) {
+                continue;
+            }
+
+            std::ifstream cpuListFile(sysfsNodePath + "/" + name + "/cpulist");
+            std::string cpuList;
+            std::getline(cpuListFile, cpuList);
+            std::vector<int> cpus = ParseCpuList(cpuList);
+            if (!cpus.empty()) {
+                nodes[std::atoi(name.c_str() + 4)] = cpus;
+            }
+        }
+        closedir(dir);
+    }
+
+    if (nodes.empty()) {
+        for (size_t cpu = 0; cpu < HardwareThreads(); ++cpu) {
+            nodes[0].push_back(static_cast<int>(cpu));
+        }
+    }
+
+    for (auto& node : nodes) {
+        for (int cpu : node.second) {
+            if (static_cast<size_t>(cpu) >= cpu_node_.size()) {
+                cpu_node_.resize(cpu + 1, 0);
+            }
+            cpu_node_[cpu] = node_cpus_.size();
+        }
+        node_cpus_.push_back(node.second);
+        node_ids_.push_back(node.first);
+    }
+}
+
+const NumaTopology& NumaTopology::System() {
+    static const NumaTopology topology;
+    return topology;
+}
+
+size_t NumaTopology::NodeOfCpu(int cpu) const {
+    if (cpu < 0 || static_cast<size_t>(cpu) >= cpu_node_.size()) {
+        return 0;
+    }
+    return cpu_node_[cpu];
+}
+
+size_t NumaTopology::CurrentNode() const { return NodeOfCpu(sched_getcpu()); }
+
+bool NumaTopology::BindThreadToNode(size_t node) const {
+    if (node >= node_cpus_.size()) {
+        return false;
+    }
+
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    for (int cpu : node_cpus_[node]) {
+        CPU_SET(cpu, &cpuSet);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+}
+
+// Parses the kernel cpu list format, e.g. "0-3,8,10-11"
+std::vector<int> NumaTopology::ParseCpuList(const std::string& cpuList) {
+    std::vector<int> cpus;
+    std::stringstream stream(cpuList);
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty() || range.find_first_not_of("0123456789- \n") != std::string::npos) {
+            continue;
+        }
+
+        size_t dash = range.find('-');
+        int first = std::atoi(range.c_str());
+        int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
@@ -0,0 +1,42 @@
+#ifndef NUMATOPOLOGY_HPP
+#define NUMATOPOLOGY_HPP
+
+#include <string>
+#include <vector>
+
+namespace libmsgpass {
+
+// NUMA nodes of the machine and the CPUs attached to each of them, as described by the
+// kernel under /sys/devices/system/node. Machines without NUMA support are described as a
+// single node holding all the CPUs.
+class NumaTopology {
+   public:
+    explicit NumaTopology(const std::string& sysfsNodePath = "/sys/devices/system/node");
+
+    // Topology of the running machine, read only once
+    static const NumaTopology& System();
+
+    size_t NodeCount() const { return node_cpus_.size(); }
+    // Kernel id of the node, as used in sysfs and by mbind. Node indexes are contiguous, ids may
+    // not be.
+    int NodeId(size_t node) const { return node_ids_[node]; }
+    const std::vector<int>& NodeCpus(size_t node) const { return node_cpus_[node]; }
+    // Node of the given cpu, or node 0 if the cpu is unknown
+    size_t NodeOfCpu(int cpu) const;
+    // Node of the cpu the calling thread is running on
+    size_t CurrentNode() const;
+
+    // Restricts the calling thread to the CPUs of the given node. Returns false on failure.
+    bool BindThreadToNode(size_t node) const;
+
+    static std::vector<int> ParseCpuList(const std::string& cpuList);
+
+   private:
+    std::vector<std::vector<int>> node_cpus_;
+    std::vector<int> node_ids_;
+    std::vector<size_t> cpu_node_;
+};
+
+}  // namespace libmsgpass
+
+#endif /* NUMATOPOLOGY_HPP */
@@ -0,0 +1,44 @@
+#ifndef PARKER_HPP
+#define PARKER_HPP
+
+#include <condition_variable>
+#include <mutex>
+
+namespace libmsgpass {
+
+// A thread sleeping until another one wakes it up. Each parked thread has its own lock and
+// condition variable, so waking it up disturbs no other thread, and it is woken up once, by the
+// operation that completes its wait.
+class Parker {
+   public:
+    Parker() = default;
+    Parker(const Parker&) = delete;
+
+    // Runs update under the lock, e.g. to hand over a value, then wakes the parked thread up.
+    // Notifying under the lock keeps the parker alive until the caller is done with it.
+    template <typename Update>
+    void Wake(Update update) {
+        std::unique_lock<std::mutex> lock_guard(mutex_);
+        update();
+        woken_ = true;
+        cond_var_.notify_one();
+    }
+
+    void Wake() {
+        Wake([]() {});
+    }
+
+    void Wait() {
+        std::unique_lock<std::mutex> lock_guard(mutex_);
+        cond_var_.wait(lock_guard, [this]() { return woken_; });
+    }
+
+   private:
+    bool woken_ = false;
+    std::mutex mutex_;
+    std::condition_variable cond_var_;
+};
+
+}  // namespace libmsgpass
+
+#endif /* PARKER_HPP */
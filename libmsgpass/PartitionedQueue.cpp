@@ -0,0 +1,60 @@
+#include "PartitionedQueue.hpp"
+
+using namespace libmsgpass;
+
+PartitionedQueue::PartitionedQueue(size_t lanes, KeyExtractor key)
+    : lane_count_(lanes > 0 ? lanes : 1), key_(key), lanes_(new Lane[lane_count_]) {}
+
+size_t PartitionedQueue::KeyArg1(int, int arg1, int, void*) { return static_cast<size_t>(arg1); }
+
+void PartitionedQueue::Send(int what, int arg1, int arg2, void* obj) {
+    // Fibonacci hashing, so that consecutive keys land on different lanes
+    uint64_t hash = static_cast<uint64_t>(key_(what, arg1, arg2, obj)) * 0x9E3779B97F4A7C15ull;
+    size_t lane = static_cast<size_t>(hash >> 32) % lane_count_;
+
+    lanes_[lane].queue.Send(what, arg1, arg2, obj);
+    Schedule(lane);
+}
+
+size_t PartitionedQueue::ClearMsgType(int what) {
+    size_t removed = 0;
+    for (size_t i = 0; i < lane_count_; ++i) {
+        removed += lanes_[i].queue.ClearMsgType(what);
+    }
+    return removed;
+}
+
+size_t PartitionedQueue::Count() const {
+    size_t count = 0;
+    for (size_t i = 0; i < lane_count_; ++i) {
+        count += lanes_[i].queue.Count();
+    }
+    return count;
+}
+
+size_t PartitionedQueue::AcquireLane() {
+    size_t lane = 0;
+    ready_.Receive([&lane](int, int arg1, int, void*) { lane = static_cast<size_t>(arg1); });
+    return lane;
+}
+
+void PartitionedQueue::ReleaseLane(size_t lane) {
+    Lane& released = lanes_[lane];
+    if (released.queue.Count() > 0) {
+        // Still scheduled, back to the end of the ready list
+        ready_.Send(0, static_cast<int>(lane), 0, nullptr);
+        return;
+    }
+
+    // A Send may have seen the lane scheduled just before we cleared the flag
+    released.scheduled.store(false);
+    if (released.queue.Count() > 0) {
+        Schedule(lane);
+    }
+}
+
+void PartitionedQueue::Schedule(size_t lane) {
+    if (!lanes_[lane].scheduled.exchange(true)) {
+        ready_.Send(0, static_cast<int>(lane), 0, nullptr);
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef PARTITIONEDQUEUE_HPP
+#define PARTITIONEDQUEUE_HPP
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include "CacheLine.hpp"
+#include "MessageQueue.hpp"
+
+namespace libmsgpass {
+
+// Message queue split in ordered lanes selected by a key extracted from each message. Messages
+// with the same key always go to the same lane, and a lane is only handed to one consumer at a
+// time, so they are processed one after the other and in order, while different lanes are
+// processed in parallel by any of the consumers.
+class PartitionedQueue {
+   public:
+    typedef std::function<size_t(int what, int arg1, int arg2, void* obj)> KeyExtractor;
+
+    // By default messages are keyed by arg1
+    explicit PartitionedQueue(size_t lanes, KeyExtractor key = KeyArg1);
+    PartitionedQueue(const PartitionedQueue&) = delete;
+
+    void Send(int what, int arg1, int arg2, void* obj);
+    size_t ClearMsgType(int what);
+    size_t Count() const;
+    size_t LaneCount() const { return lane_count_; }
+
+    // Processes the next message of the next lane ready to run
+    template <typename Oper>
+    void Receive(Oper oper) {
+        while (ReceiveBatch(oper, 1) == 0) {
+        }
+    }
+
+    // Takes the next lane ready to run and processes up to maxMessages of it, in order. The lane
+    // then goes back to the end of the ready list if it still has messages, so busy lanes are
+    // spread over all the consumers. Returns the number of messages processed.
+    template <typename Oper>
+    size_t ReceiveBatch(Oper oper, size_t maxMessages) {
+        LaneClaim claim(*this, AcquireLane());
+        size_t processed = 0;
+        while (processed < maxMessages && lanes_[claim.lane].queue.TryReceive(oper)) {
+            processed++;
+        }
+        return processed;
+    }
+
+    static size_t KeyArg1(int what, int arg1, int arg2, void* obj);
+
+   private:
+    struct Lane : public CacheLineAligned {
+        MessageQueue queue;
+        // Set while the lane is in the ready list or being processed
+        std::atomic<bool> scheduled;
+
+        Lane() : scheduled(false) {}
+    };
+
+    // Gives the lane back when the consumer is done with it, even if the operation throws
+    struct LaneClaim {
+        PartitionedQueue& owner;
+        size_t lane;
+
+        LaneClaim(PartitionedQueue& owner, size_t lane) : owner(owner), lane(lane) {}
+        ~LaneClaim() { owner.ReleaseLane(lane); }
+    };
+
+    size_t AcquireLane();
+    void ReleaseLane(size_t lane);
+    void Schedule(size_t lane);
+
+    const size_t lane_count_;
+    const KeyExtractor key_;
+    std::unique_ptr<Lane[]> lanes_;
+    // Indexes of the lanes with messages waiting for a consumer, in arg1
+    MessageQueue ready_;
+};
+
+}  // namespace libmsgpass
+
+#endif /* PARTITIONEDQUEUE_HPP */
@@ -0,0 +1,19 @@
+#include "PendingCounter.hpp"
+
+using namespace libmsgpass;
+
+void PendingCounter::Added() {
+    pending_.fetch_add(1);
+    // Only touch the shared lock when some consumer is actually sleeping
+    if (sleepers_.load() > 0) {
+        std::unique_lock<std::mutex> lock_guard(mutex_);
+        cond_var_.notify_one();
+    }
+}
+
+void PendingCounter::Wait() {
+    std::unique_lock<std::mutex> lock_guard(mutex_);
+    sleepers_.fetch_add(1);
+    cond_var_.wait(lock_guard, [this]() { return pending_.load() > 0; });
+    sleepers_.fetch_sub(1);
+}
@@ -0,0 +1,46 @@
+#ifndef PENDINGCOUNTER_HPP
+#define PENDINGCOUNTER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+#include "CacheLine.hpp"
+
+namespace libmsgpass {
+
+// Number of messages pending in the sub-queues of a composite queue, e.g. the shards of a
+// ShardedMessageQueue, and the consumers sleeping until there is one. Producers count a message
+// after publishing it in its sub-queue, so a consumer can take it and uncount it first: the
+// counter is signed and may go briefly negative.
+class PendingCounter {
+   public:
+    PendingCounter() : pending_(0), sleepers_(0) {}
+    PendingCounter(const PendingCounter&) = delete;
+
+    // Called once the message is in its sub-queue. Wakes up a sleeping consumer.
+    void Added();
+    void Removed(size_t count = 1) { pending_.fetch_sub(static_cast<int64_t>(count)); }
+
+    bool Empty() const { return pending_.load() <= 0; }
+    size_t Count() const {
+        int64_t pending = pending_.load();
+        return pending > 0 ? static_cast<size_t>(pending) : 0;
+    }
+
+    // Sleeps until some message is pending
+    void Wait();
+
+   private:
+    // Updated by every Send and Receive, while the members below are only used by sleeping
+    // consumers and the producers waking them up
+    alignas(CacheLineSize) std::atomic<int64_t> pending_;
+    alignas(CacheLineSize) std::atomic<size_t> sleepers_;
+    std::mutex mutex_;
+    std::condition_variable cond_var_;
+};
+
+}  // namespace libmsgpass
+
+#endif /* PENDINGCOUNTER_HPP */
@@ -0,0 +1,191 @@
+#include "PoolAllocator.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+using namespace libmsgpass;
+
+namespace {
+
+const size_t Granularity = alignof(std::max_align_t);
+const size_t ClassCount = NodePool::MaxBlockSize / Granularity;
+// Number of blocks moved at once between a thread cache and the depot
+const size_t BatchSize = 64;
+const size_t MaxCached = 2 * BatchSize;
+// Thread statistics are published every StatsInterval allocations
+const uint64_t StatsInterval = 1024;
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+struct FreeList {
+    FreeBlock* head;
+    size_t count;
+};
+
+// Free blocks shared by all the threads, kept in batches so that the lock is only taken once
+// every BatchSize operations of a thread
+struct Depot {
+    std::mutex mutex;
+    std::vector<FreeList> batches[ClassCount];
+    std::atomic<uint64_t> allocations;
+    std::atomic<uint64_t> reused;
+
+    Depot() : allocations(0), reused(0) {}
+};
+
+Depot& GlobalDepot() {
+    // Never destroyed, since threads may still release their caches during shutdown
+    static Depot* depot = new Depot();
+    return *depot;
+}
+
+size_t SizeClass(size_t size) { return (size + Granularity - 1) / Granularity - 1; }
+
+size_t BlockSize(size_t sizeClass) { return (sizeClass + 1) * Granularity; }
+
+class ThreadCache {
+   public:
+    ThreadCache() : lists_(), allocations_(0), reused_(0) {}
+
+    ~ThreadCache() {
+        Depot& depot = GlobalDepot();
+        std::unique_lock<std::mutex> lock_guard(depot.mutex);
+        for (size_t sizeClass = 0; sizeClass < ClassCount; ++sizeClass) {
+            if (lists_[sizeClass].count > 0) {
+                depot.batches[sizeClass].push_back(lists_[sizeClass]);
+            }
+        }
+        lock_guard.unlock();
+        PublishStats();
+    }
+
+    void* Allocate(size_t sizeClass) {
+        if (++allocations_ % StatsInterval == 0) {
+            PublishStats();
+        }
+
+        FreeList& list = lists_[sizeClass];
+        if (list.head == nullptr && !Refill(sizeClass)) {
+            return ::operator new(BlockSize(sizeClass));
+        }
+
+        reused_++;
+        FreeBlock* block = list.head;
+        list.head = block->next;
+        list.count--;
+        return block;
+    }
+
+    void Deallocate(void* memory, size_t sizeClass) {
+        FreeList& list = lists_[sizeClass];
+        FreeBlock* block = static_cast<FreeBlock*>(memory);
+        block->next = list.head;
+        list.head = block;
+        if (++list.count >= MaxCached) {
+            Drain(sizeClass);
+        }
+    }
+
+    void PublishStats() {
+        Depot& depot = GlobalDepot();
+        depot.allocations.fetch_add(allocations_, std::memory_order_relaxed);
+        depot.reused.fetch_add(reused_, std::memory_order_relaxed);
+        allocations_ = 0;
+        reused_ = 0;
+    }
+
+   private:
+    bool Refill(size_t sizeClass) {
+        Depot& depot = GlobalDepot();
+        std::unique_lock<std::mutex> lock_guard(depot.mutex);
+        std::vector<FreeList>& batches = depot.batches[sizeClass];
+        if (batches.empty()) {
+            return false;
+        }
+        lists_[sizeClass] = batches.back();
+        batches.pop_back();
+        return true;
+    }
+
+    // Moves the most recently freed blocks to the depot, keeping the cache half full
+    void Drain(size_t sizeClass) {
+        FreeList& list = lists_[sizeClass];
+        FreeList batch = {list.head, BatchSize};
+        FreeBlock* last = list.head;
+        for (size_t i = 1; i < BatchSize; ++i) {
+            last = last->next;
+        }
+        list.head = last->next;
+        list.count -= BatchSize;
+        last->next = nullptr;
+
+        Depot& depot = GlobalDepot();
+        std::unique_lock<std::mutex> lock_guard(depot.mutex);
+        depot.batches[sizeClass].push_back(batch);
+    }
+
+    FreeList lists_[ClassCount];
+    uint64_t allocations_;
+    uint64_t reused_;
+};
+
+// Set once the cache of the thread has been destroyed. Blocks released after that, e.g. by other
+// thread local objects, go back to the global allocator.
+thread_local bool cacheDestroyed = false;
+
+struct CacheHolder {
+    ThreadCache cache;
+    ~CacheHolder() { cacheDestroyed = true; }
+};
+
+ThreadCache* LocalCache() {
+    if (cacheDestroyed) {
+        return nullptr;
+    }
+    static thread_local CacheHolder holder;
+    return &holder.cache;
+}
+
+}  // namespace
+
+void* NodePool::Allocate(size_t size) {
+    ThreadCache* cache = LocalCache();
+    if (cache == nullptr) {
+        return ::operator new(BlockSize(SizeClass(size)));
+    }
+    return cache->Allocate(SizeClass(size));
+}
+
+void NodePool::Deallocate(void* block, size_t size) {
+    ThreadCache* cache = LocalCache();
+    if (cache == nullptr) {
+        ::operator delete(block);
+        return;
+    }
+    cache->Deallocate(block, SizeClass(size));
+}
+
+PoolStats NodePool::Stats() {
+    ThreadCache* cache = LocalCache();
+    if (cache != nullptr) {
+        cache->PublishStats();
+    }
+
+    Depot& depot = GlobalDepot();
+    PoolStats stats;
+    stats.allocations = depot.allocations.load(std::memory_order_relaxed);
+    stats.reused = depot.reused.load(std::memory_order_relaxed);
+    stats.time = std::chrono::steady_clock::now();
+    return stats;
+}
+
+double NodePool::ReusedPerSecond(const PoolStats& from, const PoolStats& to) {
+    std::chrono::duration<double> elapsed = to.time - from.time;
+    if (elapsed.count() <= 0) {
+        return 0;
+    }
+    return (to.reused - from.reused) / elapsed.count();
+}
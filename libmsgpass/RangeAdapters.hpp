@@ -0,0 +1,152 @@
+#ifndef RANGEADAPTERS_HPP
+#define RANGEADAPTERS_HPP
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+namespace libmsgpass {
+
+template <typename Range, typename Pred>
+class FilterRange;
+template <typename Range, typename Fn>
+class TransformRange;
+
+// Lazy adapters shared by the input ranges of the library, e.g. BasicMessageQueue::Consume:
+//
+//     for (int id : queue.Consume().Filter(isOrder).Transform(orderId)) { ... }
+//
+// Nothing is evaluated before the loop pulls an element, and each element goes through the whole
+// chain before the next one is fetched. An adapter made from a temporary range takes it over, so
+// the chain can be written in the range-for; one made from a named range refers to it.
+//
+// The iterators model input iterators, so the ranges also work with the C++20 std::views.
+template <typename Derived>
+class RangeAdapters {
+   public:
+    // Skips the elements for which pred(element) is false
+    template <typename Pred>
+    FilterRange<Derived, Pred> Filter(Pred pred) && {
+        return FilterRange<Derived, Pred>(std::move(Self()), std::move(pred));
+    }
+
+    template <typename Pred>
+    FilterRange<Derived&, Pred> Filter(Pred pred) & {
+        return FilterRange<Derived&, Pred>(Self(), std::move(pred));
+    }
+
+    // Yields fn(element) instead of each element
+    template <typename Fn>
+    TransformRange<Derived, Fn> Transform(Fn fn) && {
+        return TransformRange<Derived, Fn>(std::move(Self()), std::move(fn));
+    }
+
+    template <typename Fn>
+    TransformRange<Derived&, Fn> Transform(Fn fn) & {
+        return TransformRange<Derived&, Fn>(Self(), std::move(fn));
+    }
+
+   private:
+    Derived& Self() { return static_cast<Derived&>(*this); }
+};
+
+template <typename Range, typename Pred>
+class FilterRange : public RangeAdapters<FilterRange<Range, Pred>> {
+    typedef typename std::remove_reference<Range>::type Base;
+    typedef decltype(std::declval<Base&>().begin()) BaseIterator;
+
+   public:
+    class iterator {
+       public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef typename std::iterator_traits<BaseIterator>::value_type value_type;
+        typedef typename std::iterator_traits<BaseIterator>::reference reference;
+        typedef typename std::iterator_traits<BaseIterator>::pointer pointer;
+        typedef std::ptrdiff_t difference_type;
+
+        iterator() : range_(nullptr) {}
+        iterator(FilterRange* range, BaseIterator it) : range_(range), it_(it) { Skip(); }
+
+        reference operator*() const { return *it_; }
+
+        iterator& operator++() {
+            ++it_;
+            Skip();
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+
+        bool operator==(const iterator& other) const { return it_ == other.it_; }
+        bool operator!=(const iterator& other) const { return !(*this == other); }
+
+       private:
+        void Skip() {
+            while (it_ != range_->range_.end() && !range_->pred_(*it_)) {
+                ++it_;
+            }
+        }
+
+        FilterRange* range_;
+        BaseIterator it_;
+    };
+
+    FilterRange(Range&& range, Pred pred)
+        : range_(std::forward<Range>(range)), pred_(std::move(pred)) {}
+    FilterRange(FilterRange&&) = default;
+
+    iterator begin() { return iterator(this, range_.begin()); }
+    iterator end() { return iterator(this, range_.end()); }
+
+   private:
+    Range range_;
+    Pred pred_;
+};
+
+template <typename Range, typename Fn>
+class TransformRange : public RangeAdapters<TransformRange<Range, Fn>> {
+    typedef typename std::remove_reference<Range>::type Base;
+    typedef decltype(std::declval<Base&>().begin()) BaseIterator;
+
+   public:
+    class iterator {
+       public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef decltype(std::declval<Fn&>()(*std::declval<BaseIterator&>())) reference;
+        typedef typename std::decay<reference>::type value_type;
+        typedef void pointer;
+        typedef std::ptrdiff_t difference_type;
+
+        iterator() : range_(nullptr) {}
+        iterator(TransformRange* range, BaseIterator it) : range_(range), it_(it) {}
+
+        reference operator*() const { return range_->fn_(*it_); }
+
+        iterator& operator++() {
+            ++it_;
+            return *this;
+        }
+        void operator++(int) { ++*this; }
+
+        bool operator==(const iterator& other) const { return it_ == other.it_; }
+        bool operator!=(const iterator& other) const { return !(*this == other); }
+
+       private:
+        TransformRange* range_;
+        BaseIterator it_;
+    };
+
+    TransformRange(Range&& range, Fn fn) : range_(std::forward<Range>(range)), fn_(std::move(fn)) {}
+    TransformRange(TransformRange&&) = default;
+
+    iterator begin() { return iterator(this, range_.begin()); }
+    iterator end() { return iterator(this, range_.end()); }
+
+   private:
+    Range range_;
+    Fn fn_;
+};
+
+}  // namespace libmsgpass
+
+#endif /* RANGEADAPTERS_HPP */
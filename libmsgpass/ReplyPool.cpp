@@ -0,0 +1,102 @@
+#include "ReplyPool.hpp"
+
+using namespace libmsgpass;
+
+ReplyPool::ReplyPool(size_t slots)
+    : free_head_(0),
+      references_(1),
+      waiters_(0),
+      slots_(new ReplySlot[slots > 0 ? slots : 1]),
+      slot_count_(static_cast<uint32_t>(slots > 0 ? slots : 1)) {
+    for (uint32_t i = 0; i < slot_count_; ++i) {
+        slots_[i].pool = this;
+        slots_[i].next_free = i + 1;
+        slots_[i].state = ReplySlot::Pending;
+        slots_[i].references = 0;
+    }
+}
+
+ReplySlot* ReplyPool::Acquire() {
+    ReplySlot* slot = nullptr;
+    if (!TryPop(slot)) {
+        std::unique_lock<std::mutex> lock_guard(mutex_);
+        waiters_.fetch_add(1);
+        cond_var_.wait(lock_guard, [&]() { return TryPop(slot); });
+        waiters_.fetch_sub(1);
+    }
+
+    references_.fetch_add(1);
+    slot->state.store(ReplySlot::Pending);
+    slot->references.store(2);
+    return slot;
+}
+
+void ReplyPool::Release(ReplySlot* slot) {
+    if (slot->references.fetch_sub(1) != 1) {
+        return;
+    }
+
+    Push(slot);
+    if (waiters_.load() > 0) {
+        std::unique_lock<std::mutex> lock_guard(mutex_);
+        cond_var_.notify_one();
+    }
+    Unreference();
+}
+
+void ReplyPool::Detach() { Unreference(); }
+
+void ReplyPool::Unreference() {
+    if (references_.fetch_sub(1) == 1) {
+        delete this;
+    }
+}
+
+bool ReplyPool::TryPop(ReplySlot*& slot) {
+    uint64_t head = free_head_.load();
+    while (true) {
+        uint32_t index = static_cast<uint32_t>(head);
+        if (index == slot_count_) {
+            return false;
+        }
+
+        uint64_t tag = (head >> 32) + 1;
+        uint64_t next = (tag << 32) | slots_[index].next_free.load(std::memory_order_relaxed);
+        if (free_head_.compare_exchange_weak(head, next)) {
+            slot = &slots_[index];
+            return true;
+        }
+    }
+}
+
+void ReplyPool::Push(ReplySlot* slot) {
+    uint32_t index = static_cast<uint32_t>(slot - slots_.get());
+    uint64_t head = free_head_.load();
+    uint64_t next;
+    do {
+        slot->next_free.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+        next = (((head >> 32) + 1) << 32) | index;
+    } while (!free_head_.compare_exchange_weak(head, next));
+}
+
+void Reply::Complete(ReplySlot::State state) {
+    if (slot_ == nullptr) {
+        return;
+    }
+
+    slot_->mutex.lock();
+    slot_->state.store(state);
+    slot_->mutex.unlock();
+    slot_->cond_var.notify_all();
+
+    slot_->pool->Release(slot_);
+    slot_ = nullptr;
+}
+
+void CallFuture::Wait() const {
+    if (Ready()) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock_guard(slot_->mutex);
+    slot_->cond_var.wait(lock_guard, [this]() { return Ready(); });
+}
@@ -0,0 +1,124 @@
+#ifndef REPLYPOOL_HPP
+#define REPLYPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "CacheLine.hpp"
+#include "Message.hpp"
+
+namespace libmsgpass {
+
+class ReplyPool;
+
+// Preallocated storage for the answer to one Call. It is shared by the caller, through a
+// CallFuture, and by the consumer of the request, through a Reply.
+struct alignas(CacheLineSize) ReplySlot : public CacheLineAligned {
+    enum State { Pending, Replied, Abandoned };
+
+    ReplyPool* pool;
+    std::atomic<uint32_t> next_free;
+    std::atomic<int> state;
+    std::atomic<int> references;
+    Message answer;
+    std::mutex mutex;
+    std::condition_variable cond_var;
+};
+
+// Fixed set of reply slots. Slots are taken from a lock-free free list, and the pool only blocks
+// when all of them are in use.
+//
+// The pool is released once its owner called Detach and all the slots have been returned, so
+// outstanding futures stay valid after the queue that created them is gone.
+class ReplyPool : public CacheLineAligned {
+   public:
+    explicit ReplyPool(size_t slots);
+    ReplyPool(const ReplyPool&) = delete;
+
+    // Returns a pending slot referenced by both the caller and the consumer
+    ReplySlot* Acquire();
+    // Drops one reference to the slot, putting it back in the pool after the last one
+    void Release(ReplySlot* slot);
+    void Detach();
+
+   private:
+    ~ReplyPool() = default;
+    bool TryPop(ReplySlot*& slot);
+    void Push(ReplySlot* slot);
+    void Unreference();
+
+    // Head of the free list: slot index in the lower half, ABA tag in the upper half
+    alignas(CacheLineSize) std::atomic<uint64_t> free_head_;
+    std::atomic<size_t> references_;
+    std::atomic<size_t> waiters_;
+    std::mutex mutex_;
+    std::condition_variable cond_var_;
+    std::unique_ptr<ReplySlot[]> slots_;
+    const uint32_t slot_count_;
+};
+
+// Consumer side of a Call. The answer must be sent at most once; a Reply destroyed without
+// answering completes the call as abandoned.
+class Reply {
+   public:
+    Reply() : slot_(nullptr) {}
+    // Takes over the reply slot of a message, e.g. one received by AsyncReceive
+    explicit Reply(Message& message) : slot_(message.reply) { message.reply = nullptr; }
+    Reply(Reply&& other) : slot_(other.slot_) { other.slot_ = nullptr; }
+    Reply(const Reply&) = delete;
+    ~Reply() { Complete(ReplySlot::Abandoned); }
+
+    // Whether the sender is waiting for an answer
+    bool Expected() const { return slot_ != nullptr; }
+
+    void Send(int what, int arg1, int arg2, void* obj) {
+        if (slot_ != nullptr) {
+            slot_->answer = Message(what, arg1, arg2, obj);
+            Complete(ReplySlot::Replied);
+        }
+    }
+
+   private:
+    void Complete(ReplySlot::State state);
+
+    ReplySlot* slot_;
+};
+
+// Caller side of a Call
+class CallFuture {
+   public:
+    explicit CallFuture(ReplySlot* slot) : slot_(slot) {}
+    CallFuture(CallFuture&& other) : slot_(other.slot_) { other.slot_ = nullptr; }
+    CallFuture(const CallFuture&) = delete;
+    ~CallFuture() {
+        if (slot_ != nullptr) {
+            slot_->pool->Release(slot_);
+        }
+    }
+
+    bool Ready() const { return slot_->state.load() != ReplySlot::Pending; }
+    void Wait() const;
+
+    // Waits for the answer and passes it to the callable object. Returns false, without calling
+    // it, if the request was dropped before being answered.
+    template <typename Oper>
+    bool Get(Oper oper) const {
+        Wait();
+        if (slot_->state.load() != ReplySlot::Replied) {
+            return false;
+        }
+        const Message& answer = slot_->answer;
+        oper(answer.what, answer.arg1, answer.arg2, answer.obj);
+        return true;
+    }
+
+   private:
+    ReplySlot* slot_;
+};
+
+}  // namespace libmsgpass
+
+#endif /* REPLYPOOL_HPP */
@@ -0,0 +1,229 @@
+#ifndef SEQUENCEDRING_HPP
+#define SEQUENCEDRING_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CacheLine.hpp"
+#include "Utility.hpp"
+
+namespace libmsgpass {
+
+// Position of a producer or consumer stage in a SequencedRing: the last sequence it published or
+// finished processing. Kept in its own cache line since it is written by a single stage and read
+// by the others.
+class Sequence : public CacheLineAligned {
+   public:
+    Sequence() : value_(-1) {}
+    Sequence(const Sequence&) = delete;
+
+    int64_t Get() const { return value_.load(); }
+    void Set(int64_t value) { value_.store(value); }
+
+   private:
+    alignas(CacheLineSize) std::atomic<int64_t> value_;
+};
+
+enum class RingWait {
+    // Spins, then yields, then sleeps until signaled
+    Blocking,
+    // Spins, then yields, never sleeps
+    Yielding,
+    // Busy spins, lowest latency but keeps a core busy per waiting stage
+    BusySpin
+};
+
+// Preallocated ring of entries shared by a pipeline of stages, in the style of the LMAX
+// disruptor. Producers claim a sequence, fill the entry in place and publish it. Each consumer
+// stage sees every entry, in order, after the stages it depends on are done with it, and the
+// producers only reuse an entry once the last stages (the gating sequences) are done with it.
+// Entries are never copied between stages, and T must be default constructible.
+template <typename T>
+class SequencedRing : public CacheLineAligned {
+   public:
+    // The capacity is rounded up to a power of two
+    explicit SequencedRing(size_t capacity, RingWait wait = RingWait::Blocking)
+        : mask_(static_cast<int64_t>(RoundUpPowerOfTwo(capacity)) - 1),
+          wait_(wait),
+          entries_(new T[mask_ + 1]),
+          available_(new std::atomic<int64_t>[mask_ + 1]),
+          claimed_(-1),
+          gating_cache_(-1),
+          waiters_(0) {
+        for (int64_t i = 0; i <= mask_; ++i) {
+            available_[i].store(-1, std::memory_order_relaxed);
+        }
+    }
+    SequencedRing(const SequencedRing&) = delete;
+
+    size_t Capacity() const { return static_cast<size_t>(mask_ + 1); }
+
+    // Producers won't overwrite entries before these stages processed them. Must be set up
+    // before publishing.
+    void AddGatingSequence(const Sequence& sequence) { gating_.push_back(&sequence); }
+
+    // Claims the next entry, waiting while the ring is full. Safe to call from several producers.
+    int64_t Next() {
+        int64_t sequence = claimed_.fetch_add(1) + 1;
+        int64_t wrapPoint = sequence - (mask_ + 1);
+        if (wrapPoint > gating_cache_.load(std::memory_order_relaxed)) {
+            WaitUntil([&]() {
+                int64_t minimum = MinGating(sequence - 1);
+                gating_cache_.store(minimum, std::memory_order_relaxed);
+                return wrapPoint <= minimum;
+            });
+        }
+        return sequence;
+    }
+
+    T& operator[](int64_t sequence) { return entries_[sequence & mask_]; }
+    const T& operator[](int64_t sequence) const { return entries_[sequence & mask_]; }
+
+    // Makes a claimed entry visible to the first stages
+    void Publish(int64_t sequence) {
+        available_[sequence & mask_].store(sequence);
+        Signal();
+    }
+
+    // Claims an entry, fills it with fill(T&) and publishes it
+    template <typename Fill>
+    int64_t Publish(Fill fill) {
+        int64_t sequence = Next();
+        fill((*this)[sequence]);
+        Publish(sequence);
+        return sequence;
+    }
+
+    bool IsPublished(int64_t sequence) const {
+        return available_[sequence & mask_].load() == sequence;
+    }
+
+    // Wakes up the stages and producers sleeping on the ring
+    void Signal() {
+        if (wait_ == RingWait::Blocking && waiters_.load() > 0) {
+            std::unique_lock<std::mutex> lock_guard(mutex_);
+            cond_var_.notify_all();
+        }
+    }
+
+    // Waits until the condition holds, following the wait strategy of the ring. Whoever makes the
+    // condition true must call Signal.
+    template <typename Condition>
+    void WaitUntil(Condition condition) {
+        for (int tries = 0; !condition(); tries = std::min(tries + 1, SpinTries + YieldTries)) {
+            if (tries < SpinTries || wait_ == RingWait::BusySpin) {
+                continue;
+            }
+            if (tries < SpinTries + YieldTries || wait_ == RingWait::Yielding) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock_guard(mutex_);
+            waiters_.fetch_add(1);
+            cond_var_.wait(lock_guard, condition);
+            waiters_.fetch_sub(1);
+            return;
+        }
+    }
+
+   private:
+    enum { SpinTries = 100, YieldTries = 10 };
+
+    int64_t MinGating(int64_t minimum) const {
+        for (const Sequence* sequence : gating_) {
+            minimum = std::min(minimum, sequence->Get());
+        }
+        return minimum;
+    }
+
+    const int64_t mask_;
+    const RingWait wait_;
+    std::unique_ptr<T[]> entries_;
+    std::unique_ptr<std::atomic<int64_t>[]> available_;
+    std::vector<const Sequence*> gating_;
+
+    alignas(CacheLineSize) std::atomic<int64_t> claimed_;
+    std::atomic<int64_t> gating_cache_;
+
+    alignas(CacheLineSize) std::mutex mutex_;
+    std::condition_variable cond_var_;
+    std::atomic<size_t> waiters_;
+};
+
+// Consumer stage of a SequencedRing. A stage without dependencies processes entries as soon as
+// they are published; otherwise it waits for all the stages it depends on. Each stage must be
+// run by one thread at a time.
+template <typename T>
+class RingStage : public CacheLineAligned {
+   public:
+    explicit RingStage(SequencedRing<T>& ring, std::vector<const Sequence*> dependencies = {})
+        : ring_(ring), dependencies_(dependencies) {}
+    RingStage(const RingStage&) = delete;
+
+    // Last sequence processed by this stage, for use as dependency or gating sequence
+    const Sequence& Position() const { return position_; }
+
+    // Waits for entries and passes all the available ones to handler(T& entry, int64_t
+    // sequence), in order and in place. Returns the number of entries processed.
+    template <typename Handler>
+    size_t Process(Handler handler) {
+        int64_t next = position_.Get() + 1;
+        int64_t available = next - 1;
+        ring_.WaitUntil([&]() { return (available = Available(next)) >= next; });
+        return Handle(next, available, handler);
+    }
+
+    // Same as Process, but returns 0 instead of waiting when nothing is available
+    template <typename Handler>
+    size_t TryProcess(Handler handler) {
+        int64_t next = position_.Get() + 1;
+        return Handle(next, Available(next), handler);
+    }
+
+   private:
+    // Highest sequence that can be processed, or next - 1 if none
+    int64_t Available(int64_t next) const {
+        if (!dependencies_.empty()) {
+            int64_t minimum = dependencies_[0]->Get();
+            for (const Sequence* dependency : dependencies_) {
+                minimum = std::min(minimum, dependency->Get());
+            }
+            return minimum;
+        }
+
+        // Producers may publish out of order, stop at the first gap
+        int64_t available = next - 1;
+        while (available - next < static_cast<int64_t>(ring_.Capacity()) - 1 &&
+               ring_.IsPublished(available + 1)) {
+            available++;
+        }
+        return available;
+    }
+
+    template <typename Handler>
+    size_t Handle(int64_t next, int64_t available, Handler& handler) {
+        for (int64_t sequence = next; sequence <= available; ++sequence) {
+            handler(ring_[sequence], sequence);
+        }
+        if (available >= next) {
+            position_.Set(available);
+            ring_.Signal();
+        }
+        return static_cast<size_t>(available - next + 1);
+    }
+
+    SequencedRing<T>& ring_;
+    std::vector<const Sequence*> dependencies_;
+    Sequence position_;
+};
+
+}  // namespace libmsgpass
+
+#endif /* SEQUENCEDRING_HPP */
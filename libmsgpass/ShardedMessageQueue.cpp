@@ -0,0 +1,49 @@
+#include "ShardedMessageQueue.hpp"
+
+#include "Utility.hpp"
+
+using namespace libmsgpass;
+
+ShardedMessageQueue::ShardedMessageQueue(size_t shardCount, Ordering ordering)
+    : shard_count_(shardCount > 0 ? shardCount : 1),
+      ordering_(ordering),
+      shards_(new MessageQueue[shard_count_]) {}
+
+size_t ShardedMessageQueue::DefaultShardCount() { return HardwareThreads(); }
+
+void ShardedMessageQueue::Send(int what, int arg1, int arg2, void* obj) {
+    shards_[PickShard()].Send(what, arg1, arg2, obj);
+    pending_.Added();
+}
+
+size_t ShardedMessageQueue::ClearMsgType(int what) {
+    size_t removed = 0;
+    for (size_t i = 0; i < shard_count_; ++i) {
+        removed += shards_[i].ClearMsgType(what);
+    }
+    pending_.Removed(removed);
+    return removed;
+}
+
+size_t ShardedMessageQueue::Count() const { return pending_.Count(); }
+
+// Sequential number given to each thread the first time it uses a sharded queue. Unlike the
+// hash of std::thread::id, it spreads the threads evenly over the shards.
+static size_t ThreadIndex() {
+    static std::atomic<size_t> next_index(0);
+    static thread_local size_t index = next_index.fetch_add(1);
+    return index;
+}
+
+size_t& ShardedMessageQueue::ThreadCursor() {
+    static thread_local size_t cursor = ThreadIndex();
+    return cursor;
+}
+
+size_t ShardedMessageQueue::PickShard() {
+    static thread_local size_t home = ThreadIndex();
+    if (ordering_ == Ordering::PerProducer) {
+        return home % shard_count_;
+    }
+    return home++ % shard_count_;
+}
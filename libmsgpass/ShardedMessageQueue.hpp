@@ -0,0 +1,78 @@
+#ifndef SHARDEDMESSAGEQUEUE_HPP
+#define SHARDEDMESSAGEQUEUE_HPP
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "MessageQueue.hpp"
+#include "PendingCounter.hpp"
+
+namespace libmsgpass {
+
+// Message queue split in several independent shards, each one with its own lock, so that
+// producers running on different threads do not contend with each other.
+class ShardedMessageQueue : public CacheLineAligned {
+   public:
+    enum class Ordering {
+        // Every producer thread always sends to the same shard, preserving the order of the
+        // messages sent by each producer.
+        PerProducer,
+        // Producers spread their messages over all the shards. There are no ordering guarantees,
+        // but the load is balanced even when there are fewer producers than consumers.
+        Balanced
+    };
+
+    explicit ShardedMessageQueue(size_t shardCount = DefaultShardCount(),
+                                 Ordering ordering = Ordering::PerProducer);
+    ShardedMessageQueue(const ShardedMessageQueue&) = delete;
+
+    void Send(int what, int arg1, int arg2, void* obj);
+    size_t ClearMsgType(int what);
+    size_t Count() const;
+    size_t ShardCount() const { return shard_count_; }
+
+    template <typename Oper>
+    void Receive(Oper oper) {
+        while (!TryReceive(oper)) {
+            pending_.Wait();
+        }
+    }
+
+    // Sweeps the shards round-robin starting after the last shard visited by the calling thread
+    template <typename Oper>
+    bool TryReceive(Oper oper) {
+        if (pending_.Empty()) {
+            return false;
+        }
+
+        size_t& cursor = ThreadCursor();
+        for (size_t i = 0; i < shard_count_; ++i) {
+            MessageQueue& shard = shards_[cursor++ % shard_count_];
+            bool received = shard.TryReceive([&](int what, int arg1, int arg2, void* obj) {
+                pending_.Removed();
+                oper(what, arg1, arg2, obj);
+            });
+            if (received) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static size_t DefaultShardCount();
+
+   private:
+    static size_t& ThreadCursor();
+    size_t PickShard();
+
+    const size_t shard_count_;
+    const Ordering ordering_;
+    // MessageQueue is cache line aligned, so the shards do not share cache lines
+    std::unique_ptr<MessageQueue[]> shards_;
+    PendingCounter pending_;
+};
+
+}  // namespace libmsgpass
+
+#endif /* SHARDEDMESSAGEQUEUE_HPP */
@@ -0,0 +1,65 @@
+#include "Strand.hpp"
+
+#include <new>
+#include <thread>
+
+using namespace libmsgpass;
+
+Strand::Strand(ThreadPool& pool, Handler handler)
+    : pool_(pool), handler_(handler), head_(nullptr), pending_(0), tail_(NewNode()) {
+    head_.store(tail_);
+}
+
+Strand::~Strand() {
+    while (tail_ != nullptr) {
+        Node* next = tail_->next.load();
+        DeleteNode(tail_);
+        tail_ = next;
+    }
+}
+
+Strand::Node* Strand::NewNode() {
+    Node* node = new (NodePool::Allocate(sizeof(Node))) Node();
+    node->next.store(nullptr, std::memory_order_relaxed);
+    return node;
+}
+
+void Strand::DeleteNode(Node* node) {
+    node->~Node();
+    NodePool::Deallocate(node, sizeof(Node));
+}
+
+void Strand::Send(int what, int arg1, int arg2, void* obj) {
+    Node* node = NewNode();
+    node->message = Message(what, arg1, arg2, obj);
+    Node* previous = head_.exchange(node, std::memory_order_acq_rel);
+    previous->next.store(node, std::memory_order_release);
+
+    // The sender that makes the strand non-empty schedules it
+    if (pending_.fetch_add(1) == 0) {
+        pool_.Submit([this]() { Run(); });
+    }
+}
+
+void Strand::Run() {
+    size_t handled = 0;
+    while (handled < BatchSize && handled < pending_.load()) {
+        // The tail node was already handled, its successor holds the next message. The successor
+        // can be briefly missing while a sender is between the exchange and the link.
+        Node* next = tail_->next.load(std::memory_order_acquire);
+        if (next == nullptr) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        DeleteNode(tail_);
+        tail_ = next;
+        handler_(next->message.what, next->message.arg1, next->message.arg2, next->message.obj);
+        handled++;
+    }
+
+    // Messages sent meanwhile are handled by a new run, after the other strands in the pool
+    if (pending_.fetch_sub(handled) > handled) {
+        pool_.Submit([this]() { Run(); });
+    }
+}
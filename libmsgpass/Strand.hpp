@@ -0,0 +1,55 @@
+#ifndef STRAND_HPP
+#define STRAND_HPP
+
+#include <atomic>
+#include <functional>
+
+#include "CacheLine.hpp"
+#include "Message.hpp"
+#include "ThreadPool.hpp"
+
+namespace libmsgpass {
+
+// Serial executor for the messages of one object. Messages sent to a strand are handled one at a
+// time and in order, on any thread of a shared pool. The strand is only submitted to the pool
+// while it has messages, so idle strands cost no thread and no wake-up.
+//
+// Messages are kept in an intrusive multi-producer single-consumer queue (Vyukov's node based
+// queue), so sending never takes a lock.
+class Strand : public CacheLineAligned {
+   public:
+    typedef std::function<void(int what, int arg1, int arg2, void* obj)> Handler;
+
+    Strand(ThreadPool& pool, Handler handler);
+    Strand(const Strand&) = delete;
+    // Pending messages are dropped. The strand must not be running.
+    ~Strand();
+
+    void Send(int what, int arg1, int arg2, void* obj);
+    size_t Count() const { return pending_.load(); }
+
+   private:
+    struct Node {
+        std::atomic<Node*> next;
+        Message message;
+    };
+
+    // Messages handled per run before yielding the pool thread to other strands
+    static const size_t BatchSize = 64;
+
+    static Node* NewNode();
+    static void DeleteNode(Node* node);
+    void Run();
+
+    ThreadPool& pool_;
+    const Handler handler_;
+
+    // Producers push at the head, the running strand pops at the tail
+    alignas(CacheLineSize) std::atomic<Node*> head_;
+    std::atomic<size_t> pending_;
+    alignas(CacheLineSize) Node* tail_;
+};
+
+}  // namespace libmsgpass
+
+#endif /* STRAND_HPP */
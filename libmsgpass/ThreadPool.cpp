@@ -0,0 +1,158 @@
+#include "ThreadPool.hpp"
+
+#include <new>
+
+#include "Utility.hpp"
+
+using namespace libmsgpass;
+
+namespace {
+
+const int RunTask = 1;
+const int Wakeup = 2;
+const int Stop = 3;
+
+struct CurrentWorker {
+    const void* pool;
+    size_t index;
+};
+
+thread_local CurrentWorker currentWorker = {nullptr, 0};
+
+}  // namespace
+
+// Tasks are allocated from the node pool, so the allocation is usually thread local
+struct ThreadPool::Task {
+    std::function<void()> run;
+};
+
+ThreadPool::ThreadPool(size_t threads) : idle_(0), wakeup_pending_(false) {
+    for (size_t i = 0; i < (threads > 0 ? threads : 1); ++i) {
+        workers_.emplace_back(new Worker());
+    }
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i]->thread = std::thread(&ThreadPool::Run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        injection_.Send(Stop, 0, 0, nullptr);
+    }
+    for (auto& worker : workers_) {
+        worker->thread.join();
+    }
+
+    // The workers emptied their own deques before leaving, but the last tasks may still have sent
+    // work to the injection queue, e.g. when their deque was full. It is run here, and anything
+    // it submits goes to the injection queue as well.
+    Task* task = nullptr;
+    auto handle = [&task](int what, int, int, void* obj) {
+        if (what == RunTask) {
+            task = static_cast<Task*>(obj);
+        }
+    };
+    while (injection_.TryReceive(handle)) {
+        if (task != nullptr) {
+            Execute(task);
+            task = nullptr;
+        }
+    }
+}
+
+size_t ThreadPool::DefaultThreadCount() { return HardwareThreads(); }
+
+void ThreadPool::Submit(std::function<void()> task) {
+    Task* newTask = new (NodePool::Allocate(sizeof(Task))) Task{std::move(task)};
+
+    if (currentWorker.pool == this &&
+        workers_[currentWorker.index]->deque.Push(newTask)) {
+        // Pairs with the fence in Run, either the idle worker sees the task or we see it idle
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (idle_.load() > 0) {
+            WakeIdleWorker();
+        }
+        return;
+    }
+
+    injection_.Send(RunTask, 0, 0, newTask);
+}
+
+// Only one wake-up call is in flight at a time. The woken worker wakes the next one if it finds
+// more work than it can take.
+void ThreadPool::WakeIdleWorker() {
+    if (!wakeup_pending_.exchange(true)) {
+        injection_.Send(Wakeup, 0, 0, nullptr);
+    }
+}
+
+void ThreadPool::Execute(Task* task) {
+    task->run();
+    task->~Task();
+    NodePool::Deallocate(task, sizeof(Task));
+}
+
+void ThreadPool::Run(size_t index) {
+    currentWorker.pool = this;
+    currentWorker.index = index;
+    Worker& worker = *workers_[index];
+
+    Task* task = nullptr;
+    bool running = true;
+    auto handle = [&](int what, int, int, void* obj) {
+        switch (what) {
+            case RunTask:
+                task = static_cast<Task*>(obj);
+                break;
+            case Wakeup:
+                wakeup_pending_.store(false);
+                break;
+            case Stop:
+                running = false;
+                break;
+        }
+    };
+
+    while (running) {
+        task = nullptr;
+        if (worker.deque.Pop(task) || Steal(index, task) || injection_.TryReceive(handle)) {
+            if (task != nullptr) {
+                Execute(task);
+            }
+            continue;
+        }
+
+        // Announce that we are idle and look once more before parking, so that a task pushed to a
+        // deque in the meantime is not missed
+        idle_.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!Steal(index, task)) {
+            injection_.Receive(handle);
+        }
+        idle_.fetch_sub(1);
+
+        if (task != nullptr) {
+            Execute(task);
+        }
+    }
+
+    // Nobody can steal the remaining local tasks once every worker has stopped
+    while (worker.deque.Pop(task)) {
+        Execute(task);
+    }
+}
+
+bool ThreadPool::Steal(size_t index, Task*& task) {
+    size_t count = workers_.size();
+    size_t start = ThreadRandom() % count;
+    for (size_t i = 0; i < count; ++i) {
+        size_t victim = (start + i) % count;
+        if (victim != index && workers_[victim]->deque.Steal(task)) {
+            if (!workers_[victim]->deque.Empty() && idle_.load() > 0) {
+                WakeIdleWorker();
+            }
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,58 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "CacheLine.hpp"
+#include "MessageQueue.hpp"
+#include "WorkStealingDeque.hpp"
+
+namespace libmsgpass {
+
+// Work-stealing thread pool. Tasks submitted by a worker go to its own deque, tasks submitted by
+// other threads go to a shared injection queue, and idle workers steal from random victims before
+// parking on the injection queue.
+class ThreadPool {
+   public:
+    explicit ThreadPool(size_t threads = DefaultThreadCount());
+    ThreadPool(const ThreadPool&) = delete;
+    // Runs all the tasks submitted so far, then stops the workers
+    ~ThreadPool();
+
+    void Submit(std::function<void()> task);
+    size_t ThreadCount() const { return workers_.size(); }
+
+    static size_t DefaultThreadCount();
+
+   private:
+    struct Task;
+
+    struct Worker : public CacheLineAligned {
+        Worker() : deque(LocalCapacity) {}
+
+        WorkStealingDeque<Task*> deque;
+        std::thread thread;
+    };
+
+    static const size_t LocalCapacity = 1024;
+
+    void Run(size_t index);
+    bool Steal(size_t index, Task*& task);
+    void WakeIdleWorker();
+    static void Execute(Task* task);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    // Tasks from outside the pool, wake-up calls and stop requests
+    MessageQueue injection_;
+
+    alignas(CacheLineSize) std::atomic<size_t> idle_;
+    std::atomic<bool> wakeup_pending_;
+};
+
+}  // namespace libmsgpass
+
+#endif /* THREADPOOL_HPP */
@@ -0,0 +1,148 @@
+#include "Topic.hpp"
+
+#include <algorithm>
+
+#include "Utility.hpp"
+
+using namespace libmsgpass;
+
+Topic::Topic(size_t capacity, LagPolicy policy)
+    : policy_(policy),
+      mask_(RoundUpPowerOfTwo(capacity) - 1),
+      slots_(new Slot[mask_ + 1]),
+      gating_(0),
+      published_(0),
+      waiters_(0),
+      publisher_waiting_(false) {
+    for (uint64_t i = 0; i <= mask_; ++i) {
+        slots_[i].stamp = 0;
+    }
+}
+
+void Topic::Publish(int what, int arg1, int arg2, void* obj) {
+    std::unique_lock<std::mutex> lock_guard(publish_mutex_);
+    uint64_t sequence = published_.load(std::memory_order_relaxed);
+    if (policy_ == LagPolicy::Block && sequence > mask_ + gating_) {
+        WaitForSpace(sequence);
+    }
+
+    // Readers detect a torn message by checking the stamp before and after reading it
+    Slot& slot = slots_[sequence & mask_];
+    slot.stamp.store(Writing, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.what.store(what, std::memory_order_relaxed);
+    slot.arg1.store(arg1, std::memory_order_relaxed);
+    slot.arg2.store(arg2, std::memory_order_relaxed);
+    slot.obj.store(obj, std::memory_order_relaxed);
+    slot.stamp.store(sequence + 1, std::memory_order_release);
+
+    published_.store(sequence + 1);
+    lock_guard.unlock();
+
+    if (waiters_.load() > 0) {
+        std::unique_lock<std::mutex> wait_guard(wait_mutex_);
+        cond_var_.notify_all();
+    }
+}
+
+bool Topic::ReadSlot(uint64_t sequence, Message& message) const {
+    const Slot& slot = slots_[sequence & mask_];
+    if (slot.stamp.load(std::memory_order_acquire) != sequence + 1) {
+        return false;
+    }
+    message.what = slot.what.load(std::memory_order_relaxed);
+    message.arg1 = slot.arg1.load(std::memory_order_relaxed);
+    message.arg2 = slot.arg2.load(std::memory_order_relaxed);
+    message.obj = slot.obj.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.stamp.load(std::memory_order_relaxed) == sequence + 1;
+}
+
+// Called with the publish lock held. The cached minimum cursor is only refreshed when the ring
+// looks full, so the subscribers are not scanned on every publish.
+void Topic::WaitForSpace(uint64_t sequence) {
+    gating_ = MinCursor();
+    if (sequence <= mask_ + gating_) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> wait_guard(wait_mutex_);
+    publisher_waiting_.store(true);
+    cond_var_.wait(wait_guard, [&]() {
+        gating_ = MinCursor();
+        return sequence <= mask_ + gating_;
+    });
+    publisher_waiting_.store(false);
+}
+
+uint64_t Topic::MinCursor() {
+    std::unique_lock<std::mutex> lock_guard(subscribers_mutex_);
+    uint64_t minimum = published_.load();
+    for (Subscriber* subscriber : subscribers_) {
+        minimum = std::min(minimum, subscriber->cursor_.load());
+    }
+    return minimum;
+}
+
+void Topic::WaitPublished(const std::atomic<uint64_t>& cursor) {
+    std::unique_lock<std::mutex> wait_guard(wait_mutex_);
+    waiters_.fetch_add(1);
+    cond_var_.wait(wait_guard, [&]() { return published_.load() > cursor.load(); });
+    waiters_.fetch_sub(1);
+}
+
+void Topic::CursorAdvanced() {
+    if (publisher_waiting_.load()) {
+        std::unique_lock<std::mutex> wait_guard(wait_mutex_);
+        cond_var_.notify_all();
+    }
+}
+
+void Topic::Register(Subscriber* subscriber) {
+    std::unique_lock<std::mutex> lock_guard(subscribers_mutex_);
+    subscriber->cursor_.store(published_.load());
+    subscribers_.push_back(subscriber);
+}
+
+void Topic::Unregister(Subscriber* subscriber) {
+    {
+        std::unique_lock<std::mutex> lock_guard(subscribers_mutex_);
+        subscribers_.erase(std::find(subscribers_.begin(), subscribers_.end(), subscriber));
+    }
+    CursorAdvanced();
+}
+
+Topic::Subscriber::Subscriber(Topic& topic) : topic_(topic), cursor_(0), lost_(0) {
+    topic_.Register(this);
+}
+
+Topic::Subscriber::~Subscriber() { topic_.Unregister(this); }
+
+bool Topic::Subscriber::TryRead(Message& message) {
+    uint64_t cursor = cursor_.load(std::memory_order_relaxed);
+    while (true) {
+        uint64_t published = topic_.published_.load();
+        if (cursor == published) {
+            cursor_.store(cursor);
+            return false;
+        }
+
+        // Skip what has already been overwritten
+        if (published - cursor > topic_.mask_ + 1) {
+            lost_ += published - cursor - (topic_.mask_ + 1);
+            cursor = published - (topic_.mask_ + 1);
+        }
+
+        if (topic_.ReadSlot(cursor, message)) {
+            cursor_.store(cursor + 1);
+            if (topic_.policy_ == LagPolicy::Block) {
+                topic_.CursorAdvanced();
+            }
+            return true;
+        }
+
+        // Overwritten while being read, the next message is at least one ring further
+        lost_++;
+        cursor++;
+    }
+}
@@ -0,0 +1,124 @@
+#ifndef TOPIC_HPP
+#define TOPIC_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "CacheLine.hpp"
+#include "Message.hpp"
+
+namespace libmsgpass {
+
+// Broadcasts messages to any number of subscribers. Each message is written once into a shared
+// ring and every subscriber reads it through its own cursor, so the cost of publishing does not
+// depend on the number of subscribers.
+class Topic : public CacheLineAligned {
+   public:
+    // What happens when a subscriber falls a whole ring behind the publishers
+    enum class LagPolicy {
+        // The oldest messages are overwritten and the slow subscriber skips them
+        DropOldest,
+        // Publishers wait until the slowest subscriber reads the oldest message
+        Block
+    };
+
+    class Subscriber;
+
+    // The capacity is rounded up to a power of two
+    explicit Topic(size_t capacity, LagPolicy policy = LagPolicy::DropOldest);
+    Topic(const Topic&) = delete;
+
+    void Publish(int what, int arg1, int arg2, void* obj);
+
+    size_t Capacity() const { return mask_ + 1; }
+    // Number of messages published so far
+    uint64_t Published() const { return published_.load(); }
+
+   private:
+    struct Slot {
+        // Sequence number + 1 of the message in the slot, Writing while it is being replaced
+        std::atomic<uint64_t> stamp;
+        std::atomic<int> what;
+        std::atomic<int> arg1;
+        std::atomic<int> arg2;
+        std::atomic<void*> obj;
+    };
+
+    static const uint64_t Writing = ~0ull;
+
+    bool ReadSlot(uint64_t sequence, Message& message) const;
+    void WaitForSpace(uint64_t sequence);
+    uint64_t MinCursor();
+    void WaitPublished(const std::atomic<uint64_t>& cursor);
+    void CursorAdvanced();
+    void Register(Subscriber* subscriber);
+    void Unregister(Subscriber* subscriber);
+
+    const LagPolicy policy_;
+    const uint64_t mask_;
+    std::unique_ptr<Slot[]> slots_;
+
+    // Only touched by publishers
+    alignas(CacheLineSize) std::mutex publish_mutex_;
+    uint64_t gating_;
+
+    alignas(CacheLineSize) std::atomic<uint64_t> published_;
+
+    alignas(CacheLineSize) std::mutex wait_mutex_;
+    std::condition_variable cond_var_;
+    std::atomic<size_t> waiters_;
+    std::atomic<bool> publisher_waiting_;
+
+    std::mutex subscribers_mutex_;
+    std::vector<Subscriber*> subscribers_;
+};
+
+// Reads the messages published after its creation. Each subscriber must be used by one thread
+// at a time.
+class Topic::Subscriber : public CacheLineAligned {
+   public:
+    explicit Subscriber(Topic& topic);
+    Subscriber(const Subscriber&) = delete;
+    ~Subscriber();
+
+    template <typename Oper>
+    void Receive(Oper oper) {
+        Message msg;
+        while (!TryRead(msg)) {
+            topic_.WaitPublished(cursor_);
+        }
+        oper(msg.what, msg.arg1, msg.arg2, msg.obj);
+    }
+
+    template <typename Oper>
+    bool TryReceive(Oper oper) {
+        Message msg;
+        if (!TryRead(msg)) {
+            return false;
+        }
+        oper(msg.what, msg.arg1, msg.arg2, msg.obj);
+        return true;
+    }
+
+    // Messages published but not read yet, including the ones that will be skipped
+    uint64_t Count() const { return topic_.published_.load() - cursor_.load(); }
+    // Messages skipped because they were overwritten before being read
+    uint64_t Lost() const { return lost_; }
+
+   private:
+    friend class Topic;
+
+    bool TryRead(Message& message);
+
+    Topic& topic_;
+    alignas(CacheLineSize) std::atomic<uint64_t> cursor_;
+    uint64_t lost_;
+};
+
+}  // namespace libmsgpass
+
+#endif /* TOPIC_HPP */
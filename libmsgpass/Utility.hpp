@@ -0,0 +1,41 @@
+#ifndef UTILITY_HPP
+#define UTILITY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+namespace libmsgpass {
+
+// Helpers shared by the library, not part of its interface
+
+// Smallest power of two not below value, so that ring positions can be masked instead of divided
+inline uint64_t RoundUpPowerOfTwo(size_t value) {
+    uint64_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+// Number of hardware threads, or 1 when the platform can't tell
+inline size_t HardwareThreads() {
+    unsigned threads = std::thread::hardware_concurrency();
+    return threads > 0 ? threads : 1;
+}
+
+// Cheap xorshift generator, e.g. to pick steal victims or select cases. Each thread has its own
+// state, seeded from its id, so threads don't follow the same sequence.
+inline uint32_t ThreadRandom() {
+    static thread_local uint32_t state =
+        static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id())) | 1;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+}  // namespace libmsgpass
+
+#endif /* UTILITY_HPP */
@@ -0,0 +1,98 @@
+#ifndef WORKSTEALINGDEQUE_HPP
+#define WORKSTEALINGDEQUE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "CacheLine.hpp"
+#include "Utility.hpp"
+
+namespace libmsgpass {
+
+// Fixed capacity Chase-Lev deque, following the C11 formulation by Le, Pop, Cohen and Zappa
+// Nardelli. The owner thread pushes and pops at the bottom without contention while other threads
+// steal from the top. T must be trivially copyable, typically a pointer.
+template <typename T>
+class WorkStealingDeque : public CacheLineAligned {
+   public:
+    explicit WorkStealingDeque(size_t capacity)
+        : mask_(static_cast<int64_t>(RoundUpPowerOfTwo(capacity)) - 1),
+          buffer_(new std::atomic<T>[mask_ + 1]),
+          top_(0),
+          bottom_(0) {}
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+
+    // Owner only. Returns false if the deque is full.
+    bool Push(T item) {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_acquire);
+        if (bottom - top > mask_) {
+            return false;
+        }
+        buffer_[bottom & mask_].store(item, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Owner only. Takes the most recently pushed item.
+    bool Pop(T& item) {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = top_.load(std::memory_order_relaxed);
+
+        if (top > bottom) {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        T last = buffer_[bottom & mask_].load(std::memory_order_relaxed);
+        if (top == bottom) {
+            // Last item, race against the thieves for it
+            bool won = top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                                    std::memory_order_relaxed);
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+            if (!won) {
+                return false;
+            }
+        }
+        item = last;
+        return true;
+    }
+
+    // Any thread. Takes the oldest item.
+    bool Steal(T& item) {
+        int64_t top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = bottom_.load(std::memory_order_acquire);
+        if (top >= bottom) {
+            return false;
+        }
+
+        T first = buffer_[top & mask_].load(std::memory_order_relaxed);
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+            return false;
+        }
+        item = first;
+        return true;
+    }
+
+    bool Empty() const {
+        return bottom_.load(std::memory_order_relaxed) <= top_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    const int64_t mask_;
+    std::unique_ptr<std::atomic<T>[]> buffer_;
+    // Written by thieves
+    alignas(CacheLineSize) std::atomic<int64_t> top_;
+    // Written by the owner
+    alignas(CacheLineSize) std::atomic<int64_t> bottom_;
+};
+
+}  // namespace libmsgpass
+
+#endif /* WORKSTEALINGDEQUE_HPP */
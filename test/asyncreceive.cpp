@@ -0,0 +1,142 @@
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <coroutine>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "MessageQueue.hpp"
+
+using namespace libmsgpass;
+
+// Coroutine that starts immediately and destroys itself when it finishes
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return Detached(); }
+        std::suspend_never initial_suspend() { return std::suspend_never(); }
+        std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// Executor that queues the tasks until Run is called
+class ManualExecutor {
+   public:
+    void Post(std::function<void()> task) { tasks_.push_back(std::move(task)); }
+
+    size_t Run() {
+        std::vector<std::function<void()>> tasks;
+        tasks.swap(tasks_);
+        for (auto& task : tasks) {
+            task();
+        }
+        return tasks.size();
+    }
+
+   private:
+    std::vector<std::function<void()>> tasks_;
+};
+
+static Detached ReceiveOne(MessageQueue& msgQueue, int& received) {
+    Message msg = co_await msgQueue.AsyncReceive();
+    received += msg.arg1;
+}
+
+static Detached ReceiveOn(MessageQueue& msgQueue, ManualExecutor& executor, int& received,
+                          int count) {
+    for (int i = 0; i < count; ++i) {
+        Message msg = co_await msgQueue.AsyncReceive(executor);
+        received += msg.arg1;
+    }
+}
+
+TEST_CASE("Coroutines can receive messages already in the queue", "[async]") {
+    MessageQueue msgQueue;
+    int received = 0;
+
+    msgQueue.Send(1, 10, 0, nullptr);
+    ReceiveOne(msgQueue, received);
+
+    REQUIRE(received == 10);
+    REQUIRE(msgQueue.Count() == 0);
+}
+
+TEST_CASE("Suspended coroutines get the messages directly", "[async]") {
+    MessageQueue msgQueue;
+    int received = 0;
+
+    SECTION("Without an executor the coroutine resumes in the sending thread") {
+        ReceiveOne(msgQueue, received);
+        REQUIRE(received == 0);
+
+        msgQueue.Send(1, 10, 0, nullptr);
+        REQUIRE(received == 10);
+        REQUIRE(msgQueue.Count() == 0);
+    }
+
+    SECTION("With an executor the coroutine resumes when the executor runs it") {
+        ManualExecutor executor;
+        ReceiveOn(msgQueue, executor, received, 2);
+
+        msgQueue.Send(1, 10, 0, nullptr);
+        REQUIRE(received == 0);
+        REQUIRE(msgQueue.Count() == 0);
+        REQUIRE(executor.Run() == 1);
+        REQUIRE(received == 10);
+
+        // The coroutine is waiting again, so the message is handed over once more
+        msgQueue.Send(1, 20, 0, nullptr);
+        REQUIRE(executor.Run() == 1);
+        REQUIRE(received == 30);
+    }
+}
+
+TEST_CASE("Waiting receivers are woken up in the configured order", "[async]") {
+    MessageQueue msgQueue;
+    int first = 0;
+    int second = 0;
+
+    SECTION("By default the most recent receiver gets the message") {
+        ReceiveOne(msgQueue, first);
+        ReceiveOne(msgQueue, second);
+        msgQueue.Send(1, 10, 0, nullptr);
+        REQUIRE(first == 0);
+        REQUIRE(second == 10);
+        msgQueue.Send(1, 20, 0, nullptr);
+        REQUIRE(first == 20);
+    }
+
+    SECTION("In FIFO order the oldest receiver gets the message") {
+        msgQueue.SetWakeOrder(WakeOrder::Fifo);
+        ReceiveOne(msgQueue, first);
+        ReceiveOne(msgQueue, second);
+        msgQueue.Send(1, 10, 0, nullptr);
+        REQUIRE(first == 10);
+        REQUIRE(second == 0);
+        msgQueue.Send(1, 20, 0, nullptr);
+        REQUIRE(second == 20);
+    }
+}
+
+TEST_CASE("Thousands of coroutines can wait on the same queue", "[async]") {
+    const int consumers = 5000;
+    MessageQueue msgQueue;
+    ManualExecutor executor;
+    int received = 0;
+
+    for (int i = 0; i < consumers; ++i) {
+        ReceiveOn(msgQueue, executor, received, 1);
+    }
+
+    std::thread producer([&msgQueue]() {
+        for (int i = 0; i < consumers; ++i) {
+            msgQueue.Send(1, 1, 0, nullptr);
+        }
+    });
+    producer.join();
+
+    REQUIRE(msgQueue.Count() == 0);
+    REQUIRE(executor.Run() == consumers);
+    REQUIRE(received == consumers);
+}
@@ -0,0 +1,187 @@
+#include "catch.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Channel.hpp"
+
+using namespace libmsgpass;
+
+TEST_CASE("Buffered channels hold values up to their capacity", "[channel]") {
+    Channel<std::string> channel(2);
+    std::string value;
+
+    REQUIRE(channel.TrySend("first"));
+    REQUIRE(channel.TrySend("second"));
+    REQUIRE_FALSE(channel.TrySend("third"));
+    REQUIRE(channel.Count() == 2);
+
+    REQUIRE(channel.Receive(value));
+    REQUIRE(value == "first");
+
+    SECTION("Closed channels are drained before receives fail") {
+        channel.Close();
+        REQUIRE_FALSE(channel.Send("late"));
+        REQUIRE(channel.Receive(value));
+        REQUIRE(value == "second");
+        REQUIRE_FALSE(channel.Receive(value));
+        REQUIRE(value == "second");
+    }
+
+    SECTION("Values are not copied") {
+        Channel<std::unique_ptr<int>> owners(1);
+        REQUIRE(owners.Send(std::unique_ptr<int>(new int(42))));
+        std::unique_ptr<int> owner;
+        REQUIRE(owners.Receive(owner));
+        REQUIRE(*owner == 42);
+    }
+}
+
+TEST_CASE("Unbuffered channels are rendezvous points", "[channel]") {
+    Channel<int> channel;
+    int value = 0;
+
+    REQUIRE_FALSE(channel.TrySend(1));
+    REQUIRE_FALSE(channel.TryReceive(value));
+
+    SECTION("A send completes when a receiver takes the value") {
+        std::atomic<bool> sent(false);
+        std::thread sender([&]() {
+            channel.Send(7);
+            sent = true;
+        });
+        REQUIRE(channel.Receive(value));
+        sender.join();
+        REQUIRE(value == 7);
+        REQUIRE(sent);
+    }
+
+    SECTION("Closing wakes up the blocked receivers") {
+        std::atomic<int> failed(0);
+        std::vector<std::thread> receivers;
+        for (int i = 0; i < 3; ++i) {
+            receivers.emplace_back([&]() {
+                int received;
+                if (!channel.Receive(received)) {
+                    failed++;
+                }
+            });
+        }
+        channel.Close();
+        for (auto& receiver : receivers) {
+            receiver.join();
+        }
+        REQUIRE(failed == 3);
+    }
+
+    SECTION("Many senders and receivers exchange every value once") {
+        const int senders = 4;
+        const int perSender = 2000;
+        std::atomic<long> sum(0);
+        std::vector<std::thread> threads;
+        for (int s = 0; s < senders; ++s) {
+            threads.emplace_back([&]() {
+                for (int i = 1; i <= perSender; ++i) {
+                    channel.Send(i);
+                }
+            });
+            threads.emplace_back([&]() {
+                int received;
+                for (int i = 0; i < perSender; ++i) {
+                    channel.Receive(received);
+                    sum += received;
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        REQUIRE(sum == static_cast<long>(senders) * perSender * (perSender + 1) / 2);
+    }
+}
+
+TEST_CASE("Select performs one of the cases that can proceed", "[channel]") {
+    Channel<int> numbers(1);
+    Channel<std::string> names(1);
+    int number = 0;
+    std::string name;
+
+    SECTION("Without a ready case TrySelect takes the default") {
+        REQUIRE(TrySelect(Receiving(numbers, number), Receiving(names, name)) == -1);
+    }
+
+    SECTION("The ready case is performed") {
+        names.Send("ready");
+        REQUIRE(Select(Receiving(numbers, number), Receiving(names, name)) == 1);
+        REQUIRE(name == "ready");
+        REQUIRE(Select(Receiving(numbers, number), Sending(names, "again")) == 1);
+        REQUIRE(names.Count() == 1);
+    }
+
+    SECTION("Receiving reports closed channels") {
+        bool ok = true;
+        numbers.Close();
+        REQUIRE(Select(Receiving(numbers, number, ok), Receiving(names, name)) == 0);
+        REQUIRE_FALSE(ok);
+    }
+
+    SECTION("A blocked select is completed by exactly one channel") {
+        std::thread sender([&]() {
+            numbers.Send(1);
+            names.Send("two");
+        });
+        int selected = Select(Receiving(numbers, number), Receiving(names, name));
+        sender.join();
+        // Both values may be buffered before Select runs, then either case can be picked. The
+        // other value stays in its channel.
+        if (selected == 0) {
+            REQUIRE(number == 1);
+            REQUIRE(names.Count() == 1);
+            REQUIRE(numbers.Count() == 0);
+        } else {
+            REQUIRE(selected == 1);
+            REQUIRE(name == "two");
+            REQUIRE(numbers.Count() == 1);
+            REQUIRE(names.Count() == 0);
+        }
+    }
+
+    SECTION("Concurrent selects over the same channels in any order don't deadlock") {
+        const int rounds = 2000;
+        std::atomic<int> received(0);
+        std::vector<std::thread> threads;
+        threads.emplace_back([&]() {
+            for (int i = 0; i < rounds; ++i) {
+                Select(Sending(names, "x"), Sending(numbers, i));
+            }
+        });
+        threads.emplace_back([&]() {
+            for (int i = 0; i < rounds; ++i) {
+                Select(Sending(numbers, i), Sending(names, "y"));
+            }
+        });
+        threads.emplace_back([&]() {
+            for (int i = 0; i < rounds; ++i) {
+                int value;
+                std::string text;
+                Select(Receiving(numbers, value), Receiving(names, text));
+                received++;
+            }
+        });
+        threads.emplace_back([&]() {
+            for (int i = 0; i < rounds; ++i) {
+                int value;
+                std::string text;
+                Select(Receiving(names, text), Receiving(numbers, value));
+                received++;
+            }
+        });
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        REQUIRE(received == 2 * rounds);
+        REQUIRE(numbers.Count() + names.Count() == 0);
+    }
+}
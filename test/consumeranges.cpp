@@ -0,0 +1,25 @@
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <ranges>
+#include "MessageQueue.hpp"
+
+using namespace libmsgpass;
+
+TEST_CASE("Consume composes with the standard views", "[msgqueue]") {
+    MessageQueue msgQueue;
+    for (int i = 0; i < 10; ++i) {
+        msgQueue.Send(i % 2, i, 0, nullptr);
+    }
+    msgQueue.Close();
+
+    auto consumed = msgQueue.Consume(4);
+    static_assert(std::ranges::input_range<decltype(consumed)>);
+    int total = 0;
+    for (int value : consumed | std::views::filter([](Message& msg) { return msg.what == 1; }) |
+                         std::views::transform([](Message& msg) { return msg.arg1 * 10; })) {
+        total += value;
+    }
+    REQUIRE(total == (1 + 3 + 5 + 7 + 9) * 10);
+    REQUIRE(msgQueue.Count() == 0);
+}
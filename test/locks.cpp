@@ -0,0 +1,132 @@
+#include "catch.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Locks.hpp"
+#include "MessageQueue.hpp"
+
+using namespace libmsgpass;
+
+template <typename Lock>
+static void CheckMutualExclusion() {
+    const int threads = 4;
+    const int rounds = 20000;
+    Lock lock;
+    // Non-atomic on purpose, lost updates mean the lock failed
+    long counter = 0;
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; ++i) {
+        workers.emplace_back([&]() {
+            for (int n = 0; n < rounds; ++n) {
+                if (n % 2 == 0) {
+                    std::unique_lock<Lock> lock_guard(lock);
+                    counter++;
+                } else {
+                    while (!lock.try_lock()) {
+                    }
+                    counter++;
+                    lock.unlock();
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    REQUIRE(counter == threads * rounds);
+}
+
+template <typename Lock>
+static void CheckQueue() {
+    typedef BasicMessageQueue<PoolAllocator<Message>, Lock> Queue;
+    const int producers = 3;
+    const int messages = 5000;
+    Queue first;
+    Queue second;
+    std::atomic<long> sum(0);
+
+    std::thread consumer([&]() {
+        for (int n = 0; n < producers * messages; ++n) {
+            second.Receive([&](int, int arg1, int, void*) { sum += arg1; });
+        }
+    });
+    std::thread answer([&]() {
+        first.ReceiveIf([](int what, int, int, void*) { return what == 2; },
+                        [](int, int, int, void*, Reply& reply) { reply.Send(3, 0, 0, nullptr); });
+    });
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < producers; ++i) {
+        threads.emplace_back([&]() {
+            for (int n = 0; n < messages; ++n) {
+                first.Send(1, n, 0, nullptr);
+                if (n % 64 == 0) {
+                    first.TransferTo(second);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(first.Call(2, 0, 0, nullptr).Get([](int what, int, int, void*) { REQUIRE(what == 3); }));
+    answer.join();
+    first.TransferTo(second);
+    consumer.join();
+
+    REQUIRE(first.Count() == 0);
+    REQUIRE(second.Count() == 0);
+    REQUIRE(sum == static_cast<long>(producers) * messages * (messages - 1) / 2);
+}
+
+TEST_CASE("Spinning locks are mutually exclusive", "[locks]") {
+    SECTION("SpinLock") { CheckMutualExclusion<SpinLock>(); }
+    SECTION("TicketLock") { CheckMutualExclusion<TicketLock>(); }
+    SECTION("McsLock") { CheckMutualExclusion<McsLock>(); }
+}
+
+TEST_CASE("A thread can hold many MCS locks at the same time", "[locks]") {
+    const int count = 20;
+    std::unique_ptr<McsLock[]> locks(new McsLock[count]);
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < count; ++i) {
+            locks[i].lock();
+        }
+        // Released out of order
+        for (int i = 0; i < count; i += 2) {
+            locks[i].unlock();
+        }
+        for (int i = 1; i < count; i += 2) {
+            REQUIRE_FALSE(locks[i].try_lock());
+            locks[i].unlock();
+        }
+    }
+    for (int i = 0; i < count; ++i) {
+        REQUIRE(locks[i].try_lock());
+        locks[i].unlock();
+    }
+}
+
+TEST_CASE("Message queues can use any lock policy", "[locks]") {
+    SECTION("std::mutex") { CheckQueue<std::mutex>(); }
+    SECTION("SpinLock") { CheckQueue<SpinLock>(); }
+    SECTION("TicketLock") { CheckQueue<TicketLock>(); }
+    SECTION("McsLock") { CheckQueue<McsLock>(); }
+
+    SECTION("NoLock in a single thread") {
+        BasicMessageQueue<PoolAllocator<Message>, NoLock> msgQueue;
+        for (int i = 0; i < 10; ++i) {
+            msgQueue.Send(1, i, 0, nullptr);
+        }
+        msgQueue.Close();
+        int expected = 0;
+        for (Message& msg : msgQueue.Consume(4)) {
+            REQUIRE(msg.arg1 == expected++);
+        }
+        REQUIRE(expected == 10);
+        REQUIRE_FALSE(msgQueue.TryReceive([](int, int, int, void*) {}));
+    }
+}
@@ -0,0 +1,77 @@
+#include "catch.hpp"
+
+#include <vector>
+#include "MessageBacklog.hpp"
+
+using namespace libmsgpass;
+
+static std::vector<int> ReceiveAllArg1(MessageBacklog& backlog) {
+    std::vector<int> received;
+    while (backlog.TryReceive([&](int, int arg1, int, void*) { received.push_back(arg1); })) {
+    }
+    return received;
+}
+
+TEST_CASE("Message backlog delivers messages in order", "[backlog]") {
+    MessageBacklog backlog;
+    REQUIRE(backlog.Count() == 0);
+    REQUIRE_FALSE(backlog.TryReceive([](int, int, int, void*) {}));
+
+    // Enough messages to go through the compaction of the consumed ones
+    const int total = 5000;
+    for (int i = 0; i < total; ++i) {
+        backlog.Send(1, i, 0, nullptr);
+    }
+    for (int i = 0; i < total / 2; ++i) {
+        backlog.Receive([&](int, int arg1, int, void*) { REQUIRE(arg1 == i); });
+        backlog.Send(1, total + i, 0, nullptr);
+    }
+    std::vector<int> rest = ReceiveAllArg1(backlog);
+    REQUIRE(rest.size() == total);
+    for (int i = 0; i < total; ++i) {
+        REQUIRE(rest[i] == total / 2 + i);
+    }
+}
+
+TEST_CASE("Message backlog removes messages with the built-in filters", "[backlog]") {
+    MessageBacklog backlog;
+    // An odd count exercises the scalar tail after the vector blocks
+    const int total = 1003;
+    for (int i = 0; i < total; ++i) {
+        backlog.Send(i % 5, i, -i, nullptr);
+    }
+    // Messages already received are not considered
+    backlog.Receive([](int, int, int, void*) {});
+
+    SECTION("By sets of types") {
+        REQUIRE(backlog.RemoveTypes({1, 3}) == 401);
+        REQUIRE(backlog.RemoveTypes({1, 3}) == 0);
+        std::vector<int> rest = ReceiveAllArg1(backlog);
+        REQUIRE(rest.size() == 601);
+        for (size_t i = 1; i < rest.size(); ++i) {
+            REQUIRE(rest[i - 1] < rest[i]);
+            REQUIRE(rest[i] % 5 != 1);
+            REQUIRE(rest[i] % 5 != 3);
+        }
+    }
+
+    SECTION("By ranges of arg1, bounds included") {
+        REQUIRE(backlog.RemoveArg1Range(100, 199) == 100);
+        REQUIRE(backlog.RemoveArg1Range(-50, 0) == 0);
+        REQUIRE(backlog.RemoveArg1Range(1000, 2000) == 3);
+        std::vector<int> rest = ReceiveAllArg1(backlog);
+        REQUIRE(rest.size() == 899);
+        REQUIRE(rest[98] == 99);
+        REQUIRE(rest[99] == 200);
+    }
+
+    SECTION("By ranges of arg2") {
+        REQUIRE(backlog.RemoveArg2Range(-10, -1) == 10);
+        REQUIRE(backlog.Count() == 992);
+    }
+
+    SECTION("With any predicate") {
+        REQUIRE(backlog.RemoveIf([](int, int arg1, int, void*) { return arg1 % 2 == 0; }) == 501);
+        REQUIRE(backlog.Count() == 501);
+    }
+}
@@ -3,8 +3,11 @@
 
 #include <iostream>
 #include <functional>
+#include <memory>
 #include <atomic>
+#include <chrono>
 #include <thread>
+#include <vector>
 #include "MessageQueue.hpp"
 
 using namespace libmsgpass;
@@ -48,6 +51,29 @@ TEST_CASE("Message queue can send and receive", "[msgqueue]") {
     }
 }
 
+TEST_CASE("Message queue can be polled without blocking", "[msgqueue]") {
+    MessageQueue msgQueue;
+
+    SECTION("Polling an empty queue does not call the callable") {
+        bool called = false;
+        REQUIRE_FALSE(msgQueue.TryReceive([&](int, int, int, void*) { called = true; }));
+        REQUIRE_FALSE(called);
+    }
+
+    SECTION("Polling a queue with messages removes the first one") {
+        msgQueue.Send(1, 2, 3, nullptr);
+        msgQueue.Send(4, 5, 6, nullptr);
+
+        REQUIRE(msgQueue.TryReceive([](int what, int arg1, int arg2, void* obj) {
+            REQUIRE(what == 1);
+            REQUIRE(arg1 == 2);
+            REQUIRE(arg2 == 3);
+            REQUIRE(obj == nullptr);
+        }));
+        REQUIRE(msgQueue.Count() == 1);
+    }
+}
+
 TEST_CASE("Message queue can send and receive multiple messages", "[msgqueue]") {
     MessageQueue msgQueue;
 
@@ -80,6 +106,16 @@ TEST_CASE("Message queue can send and receive multiple messages", "[msgqueue]")
     REQUIRE(msgQueue.Count() == 0);
 }
 
+TEST_CASE("Message queues do not share cache lines", "[msgqueue]") {
+    REQUIRE(alignof(MessageQueue) % CacheLineSize == 0);
+    REQUIRE(sizeof(MessageQueue) % CacheLineSize == 0);
+
+    std::unique_ptr<MessageQueue[]> queues(new MessageQueue[3]);
+    for (int i = 0; i < 3; ++i) {
+        REQUIRE(reinterpret_cast<uintptr_t>(&queues[i]) % CacheLineSize == 0);
+    }
+}
+
 TEST_CASE("Messages with a specific 'what' can be removed from the queue", "[msgqueue]") {
     MessageQueue msgQueue;
 
@@ -136,6 +172,747 @@ TEST_CASE("Messages with a specific 'what' can be removed from the queue", "[msg
     }
 }
 
+TEST_CASE("Message queue removes messages matching a predicate", "[msgqueue]") {
+    MessageQueue msgQueue;
+    for (int i = 0; i < 10; ++i) {
+        msgQueue.Send(i % 2, i, 0, nullptr);
+    }
+    CallFuture future = msgQueue.Call(0, 10, 0, nullptr);
+
+    REQUIRE(msgQueue.RemoveIf([](int, int arg1, int, void*) { return arg1 >= 3 && arg1 <= 10; }) ==
+            8);
+    REQUIRE_FALSE(future.Get([](int, int, int, void*) {}));
+    for (int expected : {0, 1, 2}) {
+        msgQueue.Receive([&](int, int arg1, int, void*) { REQUIRE(arg1 == expected); });
+    }
+}
+
+TEST_CASE("Messages sent with SendLatest are conflated by what and arg1", "[msgqueue]") {
+    MessageQueue msgQueue;
+    int first = 0;
+    int second = 0;
+
+    msgQueue.SendLatest(1, 10, 100, nullptr);
+    msgQueue.SendLatest(1, 20, 200, nullptr);
+    msgQueue.Send(2, 0, 0, nullptr);
+
+    SECTION("A pending message is updated in place") {
+        msgQueue.SendLatest(1, 10, 101, &first);
+        msgQueue.SendLatest(1, 10, 102, &second);
+        REQUIRE(msgQueue.Count() == 3);
+
+        std::vector<Message> received;
+        while (msgQueue.TryReceive([&](int what, int arg1, int arg2, void* obj) {
+            received.emplace_back(what, arg1, arg2, obj);
+        })) {
+        }
+        REQUIRE(received.size() == 3);
+        REQUIRE(received[0].arg1 == 10);
+        REQUIRE(received[0].arg2 == 102);
+        REQUIRE(received[0].obj == &second);
+        REQUIRE(received[1].arg2 == 200);
+        REQUIRE(received[2].what == 2);
+    }
+
+    SECTION("Plain Sends are never conflated") {
+        msgQueue.Send(1, 10, 101, nullptr);
+        REQUIRE(msgQueue.Count() == 4);
+    }
+
+    SECTION("Once received, a key is queued again at the end") {
+        msgQueue.Receive([](int, int, int, void*) {});
+        msgQueue.SendLatest(1, 10, 103, nullptr);
+        REQUIRE(msgQueue.Count() == 3);
+        msgQueue.Receive([](int, int arg1, int, void*) { REQUIRE(arg1 == 20); });
+        msgQueue.Receive([](int what, int, int, void*) { REQUIRE(what == 2); });
+        msgQueue.Receive([](int, int, int arg2, void*) { REQUIRE(arg2 == 103); });
+    }
+
+    SECTION("Removed messages are no longer conflated") {
+        REQUIRE(msgQueue.ClearMsgType(1) == 2);
+        msgQueue.SendLatest(1, 10, 104, nullptr);
+        REQUIRE(msgQueue.Count() == 2);
+    }
+}
+
+TEST_CASE("Messages can be merged into the last pending one", "[msgqueue]") {
+    MessageQueue msgQueue;
+    msgQueue.SetCombiner(1, [](Message& pending, const Message& incoming) {
+        pending.arg1 += incoming.arg1;
+        return true;
+    });
+
+    SECTION("Consecutive messages of the same type are merged") {
+        for (int i = 1; i <= 100; ++i) {
+            msgQueue.Send(1, i, 0, nullptr);
+        }
+        REQUIRE(msgQueue.Count() == 1);
+        msgQueue.Receive([](int what, int arg1, int, void*) {
+            REQUIRE(what == 1);
+            REQUIRE(arg1 == 5050);
+        });
+    }
+
+    SECTION("Messages are never merged across another type") {
+        msgQueue.Send(1, 1, 0, nullptr);
+        msgQueue.Send(2, 0, 0, nullptr);
+        msgQueue.Send(1, 2, 0, nullptr);
+        msgQueue.Send(1, 3, 0, nullptr);
+        REQUIRE(msgQueue.Count() == 3);
+        msgQueue.Receive([](int, int arg1, int, void*) { REQUIRE(arg1 == 1); });
+        msgQueue.Receive([](int what, int, int, void*) { REQUIRE(what == 2); });
+        msgQueue.Receive([](int, int arg1, int, void*) { REQUIRE(arg1 == 5); });
+    }
+
+    SECTION("Calls are never merged") {
+        msgQueue.Send(1, 1, 0, nullptr);
+        CallFuture future = msgQueue.Call(1, 2, 0, nullptr);
+        msgQueue.Send(1, 3, 0, nullptr);
+        REQUIRE(msgQueue.Count() == 3);
+    }
+
+    SECTION("Messages indexed by SendLatest or SendTracked are never merged into") {
+        msgQueue.SendLatest(1, 10, 0, nullptr);
+        msgQueue.Send(1, 5, 0, nullptr);
+        REQUIRE(msgQueue.Count() == 2);
+        msgQueue.Receive([](int, int arg1, int, void*) { REQUIRE(arg1 == 10); });
+        msgQueue.SendLatest(1, 10, 1, nullptr);
+        REQUIRE(msgQueue.Count() == 2);
+        msgQueue.Receive([](int, int arg1, int, void*) { REQUIRE(arg1 == 5); });
+        msgQueue.Receive([](int, int arg1, int arg2, void*) {
+            REQUIRE(arg1 == 10);
+            REQUIRE(arg2 == 1);
+        });
+
+        MessageHandle handle = msgQueue.SendTracked(1, 1, 0, nullptr);
+        msgQueue.Send(1, 2, 0, nullptr);
+        REQUIRE(msgQueue.Count() == 2);
+        REQUIRE(msgQueue.Update(handle, 3, 0, nullptr));
+        msgQueue.Receive([](int, int arg1, int, void*) { REQUIRE(arg1 == 3); });
+    }
+
+    SECTION("A combiner can refuse to merge") {
+        msgQueue.SetCombiner(1, [](Message& pending, const Message& incoming) {
+            return pending.obj == incoming.obj;
+        });
+        int object = 0;
+        msgQueue.Send(1, 1, 0, nullptr);
+        msgQueue.Send(1, 2, 0, &object);
+        REQUIRE(msgQueue.Count() == 2);
+    }
+
+    SECTION("Merging stops when the combiner is removed") {
+        msgQueue.SetCombiner(1, MessageQueue::Combiner());
+        msgQueue.Send(1, 1, 0, nullptr);
+        msgQueue.Send(1, 2, 0, nullptr);
+        REQUIRE(msgQueue.Count() == 2);
+    }
+}
+
+TEST_CASE("Messages matching a predicate can be received out of order", "[msgqueue]") {
+    MessageQueue msgQueue;
+    for (int i = 0; i < 5; ++i) {
+        msgQueue.Send(1, i, 0, nullptr);
+    }
+
+    SECTION("The first matching message is taken and the others stay in order") {
+        msgQueue.ReceiveIf([](int, int arg1, int, void*) { return arg1 % 2 == 1; },
+                           [](int, int arg1, int, void*) { REQUIRE(arg1 == 1); });
+        REQUIRE(msgQueue.Count() == 4);
+        for (int expected : {0, 2, 3, 4}) {
+            msgQueue.Receive([&](int, int arg1, int, void*) { REQUIRE(arg1 == expected); });
+        }
+    }
+
+    SECTION("A waiting receiver gets the matching message when it arrives") {
+        std::atomic<int> received(-1);
+        std::thread waiter([&]() {
+            msgQueue.ReceiveIf([](int, int arg1, int, void*) { return arg1 == 100; },
+                               [&](int, int arg1, int, void*) { received = arg1; });
+        });
+
+        // Remove messages the waiter may already have checked, then add new ones
+        for (int i = 0; i < 3; ++i) {
+            msgQueue.Receive([](int, int, int, void*) {});
+        }
+        for (int i = 5; i < 50; ++i) {
+            msgQueue.Send(1, i, 0, nullptr);
+            msgQueue.TryReceive([](int, int, int, void*) {});
+        }
+        msgQueue.Send(1, 100, 0, nullptr);
+        msgQueue.Send(1, 101, 0, nullptr);
+        waiter.join();
+
+        REQUIRE(received == 100);
+        REQUIRE(msgQueue.Count() == 3);
+    }
+
+    SECTION("A plain receiver is still woken up while a selective one waits") {
+        MessageQueue emptyQueue;
+        std::atomic<int> received(0);
+        std::thread selective([&]() {
+            emptyQueue.ReceiveIf([](int what, int, int, void*) { return what == 2; },
+                                 [&](int, int, int, void*) { received++; });
+        });
+        std::thread plain([&]() { emptyQueue.Receive([&](int, int, int, void*) { received++; }); });
+
+        emptyQueue.Send(1, 0, 0, nullptr);
+        emptyQueue.Send(2, 0, 0, nullptr);
+        selective.join();
+        plain.join();
+        REQUIRE(received == 2);
+    }
+}
+
+TEST_CASE("Messages sent with SendTracked can be cancelled or updated", "[msgqueue]") {
+    MessageQueue msgQueue;
+    msgQueue.Send(1, 0, 0, nullptr);
+    MessageHandle handle = msgQueue.SendTracked(2, 10, 20, nullptr);
+    msgQueue.Send(3, 0, 0, nullptr);
+
+    SECTION("A pending message can be cancelled once") {
+        REQUIRE(msgQueue.Cancel(handle));
+        REQUIRE_FALSE(msgQueue.Cancel(handle));
+        REQUIRE(msgQueue.Count() == 2);
+        msgQueue.Receive([](int what, int, int, void*) { REQUIRE(what == 1); });
+        msgQueue.Receive([](int what, int, int, void*) { REQUIRE(what == 3); });
+    }
+
+    SECTION("A pending message can be updated in place") {
+        REQUIRE(msgQueue.Update(handle, 11, 21, &msgQueue));
+        msgQueue.Receive([](int what, int, int, void*) { REQUIRE(what == 1); });
+        msgQueue.Receive([&](int what, int arg1, int arg2, void* obj) {
+            REQUIRE(what == 2);
+            REQUIRE(arg1 == 11);
+            REQUIRE(arg2 == 21);
+            REQUIRE(obj == &msgQueue);
+        });
+    }
+
+    SECTION("Handles of received messages are stale") {
+        msgQueue.Receive([](int, int, int, void*) {});
+        msgQueue.Receive([](int, int, int, void*) {});
+        // The node may be reused by the next message
+        MessageHandle other = msgQueue.SendTracked(4, 0, 0, nullptr);
+        REQUIRE_FALSE(msgQueue.Cancel(handle));
+        REQUIRE_FALSE(msgQueue.Update(handle, 0, 0, nullptr));
+        REQUIRE(msgQueue.Count() == 2);
+        REQUIRE(msgQueue.Cancel(other));
+    }
+
+    SECTION("Handles of removed messages are stale") {
+        REQUIRE(msgQueue.ClearMsgType(2) == 1);
+        REQUIRE_FALSE(msgQueue.Cancel(handle));
+    }
+}
+
+TEST_CASE("Messages pointing to an object can be removed from the queue", "[msgqueue]") {
+    MessageQueue msgQueue;
+    int first = 0;
+    int second = 0;
+
+    msgQueue.Send(1, 0, 0, &first);
+    msgQueue.Send(1, 1, 0, &second);
+    msgQueue.Send(1, 2, 0, nullptr);
+    msgQueue.Send(1, 3, 0, &first);
+
+    SECTION("Only the messages of that object are removed") {
+        REQUIRE(msgQueue.ClearObject(&first) == 2);
+        REQUIRE(msgQueue.ClearObject(&first) == 0);
+        msgQueue.Receive([](int, int arg1, int, void*) { REQUIRE(arg1 == 1); });
+        msgQueue.Receive([](int, int arg1, int, void*) { REQUIRE(arg1 == 2); });
+    }
+
+    SECTION("Messages sent and received afterwards are kept in the index") {
+        REQUIRE(msgQueue.ClearObject(&second) == 1);
+        msgQueue.Receive([](int, int arg1, int, void*) { REQUIRE(arg1 == 0); });
+        for (int i = 4; i < 100; ++i) {
+            msgQueue.Send(1, i, 0, i % 2 == 0 ? &first : &second);
+            msgQueue.Receive([](int, int, int, void*) {});
+        }
+        REQUIRE(msgQueue.Count() == 2);
+        REQUIRE(msgQueue.ClearObject(&first) == 1);
+        REQUIRE(msgQueue.ClearObject(&second) == 1);
+        REQUIRE(msgQueue.Count() == 0);
+    }
+
+    SECTION("Objects replaced in place are indexed under the new one") {
+        REQUIRE(msgQueue.ClearObject(&second) == 1);
+        MessageHandle handle = msgQueue.SendTracked(2, 0, 0, &first);
+        REQUIRE(msgQueue.Update(handle, 0, 0, &second));
+        REQUIRE(msgQueue.ClearObject(&first) == 2);
+        REQUIRE(msgQueue.ClearObject(&second) == 1);
+        REQUIRE(msgQueue.Count() == 1);
+    }
+
+    SECTION("Pending calls are abandoned") {
+        CallFuture future = msgQueue.Call(2, 0, 0, &second);
+        REQUIRE(msgQueue.ClearObject(&second) == 2);
+        REQUIRE_FALSE(future.Get([](int, int, int, void*) {}));
+    }
+}
+
+// Allocator whose instances only compare equal when they have the same id
+template <typename T>
+struct TaggedAllocator {
+    typedef T value_type;
+
+    explicit TaggedAllocator(int id) : id(id) {}
+    template <typename U>
+    TaggedAllocator(const TaggedAllocator<U>& other) : id(other.id) {}
+
+    T* allocate(size_t n) { return std::allocator<T>().allocate(n); }
+    void deallocate(T* memory, size_t n) { std::allocator<T>().deallocate(memory, n); }
+
+    int id;
+};
+
+template <typename T, typename U>
+bool operator==(const TaggedAllocator<T>& a, const TaggedAllocator<U>& b) {
+    return a.id == b.id;
+}
+
+template <typename T, typename U>
+bool operator!=(const TaggedAllocator<T>& a, const TaggedAllocator<U>& b) {
+    return a.id != b.id;
+}
+
+TEST_CASE("Messages only move between queues with equal allocators", "[msgqueue]") {
+    typedef BasicMessageQueue<TaggedAllocator<Message>> TaggedQueue;
+    TaggedQueue first((TaggedAllocator<Message>(1)));
+    TaggedQueue second((TaggedAllocator<Message>(2)));
+    TaggedQueue third((TaggedAllocator<Message>(1)));
+    first.Send(1, 0, 0, nullptr);
+    first.Send(1, 1, 0, nullptr);
+
+    REQUIRE(first.TransferTo(second) == 0);
+    REQUIRE(second.StealHalf(first) == 0);
+    REQUIRE(first.Count() == 2);
+    REQUIRE(first.TransferTo(third) == 2);
+    REQUIRE(third.Count() == 2);
+}
+
+TEST_CASE("Pending messages can be moved to another queue", "[msgqueue]") {
+    MessageQueue source;
+    MessageQueue target;
+    for (int i = 0; i < 5; ++i) {
+        source.Send(1, i, 0, nullptr);
+    }
+    target.Send(1, 100, 0, nullptr);
+
+    SECTION("The whole backlog is moved after the messages of the target") {
+        REQUIRE(source.TransferTo(target) == 5);
+        REQUIRE(source.Count() == 0);
+        REQUIRE(source.TransferTo(target) == 0);
+        for (int expected : {100, 0, 1, 2, 3, 4}) {
+            target.Receive([&](int, int arg1, int, void*) { REQUIRE(arg1 == expected); });
+        }
+    }
+
+    SECTION("The newest half is stolen and the oldest messages stay") {
+        REQUIRE(target.StealHalf(source) == 3);
+        REQUIRE(source.Count() == 2);
+        for (int expected : {0, 1}) {
+            source.Receive([&](int, int arg1, int, void*) { REQUIRE(arg1 == expected); });
+        }
+        for (int expected : {100, 2, 3, 4}) {
+            target.Receive([&](int, int arg1, int, void*) { REQUIRE(arg1 == expected); });
+        }
+    }
+
+    SECTION("Moved messages keep their handles and calls") {
+        MessageHandle handle = source.SendTracked(2, 0, 0, nullptr);
+        CallFuture future = source.Call(3, 0, 0, nullptr);
+        REQUIRE(source.TransferTo(target) == 7);
+        REQUIRE_FALSE(source.Cancel(handle));
+        REQUIRE(target.Cancel(handle));
+        REQUIRE(target.ClearMsgType(1) == 6);
+        target.Receive([](int what, int, int, void*, Reply& reply) {
+            REQUIRE(what == 3);
+            reply.Send(0, 42, 0, nullptr);
+        });
+        REQUIRE(future.Get([](int, int arg1, int, void*) { REQUIRE(arg1 == 42); }));
+    }
+
+    SECTION("Moved messages stay conflated in the target") {
+        source.SendLatest(2, 7, 1, nullptr);
+        REQUIRE(target.StealHalf(source) == 3);
+        target.SendLatest(2, 7, 2, nullptr);
+        REQUIRE(target.Count() == 4);
+        REQUIRE(target.ClearMsgType(1) == 3);
+        target.Receive([](int, int, int arg2, void*) { REQUIRE(arg2 == 2); });
+    }
+
+    SECTION("A consumer waiting on the target gets the messages") {
+        MessageQueue idle;
+        std::atomic<int> received(0);
+        std::thread consumer([&]() {
+            for (int i = 0; i < 5; ++i) {
+                idle.Receive([&](int, int, int, void*) { received++; });
+            }
+        });
+        REQUIRE(source.TransferTo(idle) == 5);
+        consumer.join();
+        REQUIRE(received == 5);
+    }
+
+    SECTION("Two queues can move messages to each other concurrently") {
+        std::thread forth([&]() {
+            for (int i = 0; i < 1000; ++i) {
+                source.StealHalf(target);
+            }
+        });
+        for (int i = 0; i < 1000; ++i) {
+            target.StealHalf(source);
+        }
+        forth.join();
+        REQUIRE(source.Count() + target.Count() == 6);
+    }
+}
+
+TEST_CASE("Flush waits until the messages sent before are received", "[msgqueue]") {
+    MessageQueue msgQueue;
+
+    SECTION("The barrier is passed by the consumer and is not a message") {
+        msgQueue.Send(1, 0, 0, nullptr);
+        CallFuture flushed = msgQueue.Flush();
+        msgQueue.Send(2, 0, 0, nullptr);
+        REQUIRE(msgQueue.Count() == 2);
+        REQUIRE(msgQueue.ClearMsgType(0) == 0);
+
+        msgQueue.Receive([](int what, int, int, void*) { REQUIRE(what == 1); });
+        REQUIRE_FALSE(flushed.Ready());
+        REQUIRE(msgQueue.Peek([](int what, int, int, void*) { REQUIRE(what == 2); }));
+        msgQueue.Receive([](int what, int, int, void*) { REQUIRE(what == 2); });
+        REQUIRE(flushed.Ready());
+        REQUIRE(flushed.Get([](int, int, int, void*) {}));
+    }
+
+    SECTION("A barrier at the end of the queue is passed by TryReceive") {
+        CallFuture flushed = msgQueue.Flush();
+        REQUIRE_FALSE(msgQueue.TryReceive([](int, int, int, void*) {}));
+        REQUIRE(flushed.Ready());
+    }
+
+    SECTION("ReceiveIf passes a barrier once it reaches the front") {
+        msgQueue.Send(1, 0, 0, nullptr);
+        CallFuture flushed = msgQueue.Flush();
+        msgQueue.Send(2, 0, 0, nullptr);
+
+        auto is = [](int expected) {
+            return [expected](int what, int, int, void*) { return what == expected; };
+        };
+        msgQueue.ReceiveIf(is(2), [](int, int, int, void*) {});
+        REQUIRE_FALSE(flushed.Ready());
+        msgQueue.ReceiveIf(is(1), [](int, int, int, void*) {});
+        REQUIRE(flushed.Ready());
+
+        // A consumer waiting in ReceiveIf passes a barrier sent to an empty queue
+        std::thread consumer([&]() { msgQueue.ReceiveIf(is(3), [](int, int, int, void*) {}); });
+        REQUIRE(msgQueue.Flush().Get([](int, int, int, void*) {}));
+        msgQueue.Send(3, 0, 0, nullptr);
+        consumer.join();
+        REQUIRE(msgQueue.Count() == 0);
+    }
+
+    SECTION("A barrier is abandoned if the queue is destroyed first") {
+        std::unique_ptr<MessageQueue> temporary(new MessageQueue());
+        CallFuture flushed = temporary->Flush();
+        temporary.reset();
+        REQUIRE_FALSE(flushed.Get([](int, int, int, void*) {}));
+    }
+
+    SECTION("Every message sent before the barrier is processed") {
+        std::atomic<int> processed(0);
+        std::atomic<bool> running(true);
+        std::thread consumer([&]() {
+            while (running) {
+                msgQueue.Receive([&](int what, int, int, void*) {
+                    if (what == 1) {
+                        processed++;
+                    } else {
+                        running = false;
+                    }
+                });
+            }
+        });
+
+        bool consistent = true;
+        for (int round = 1; round <= 1000; ++round) {
+            msgQueue.Send(1, 0, 0, nullptr);
+            msgQueue.Flush().Wait();
+            consistent = consistent && processed == round;
+        }
+        msgQueue.Send(2, 0, 0, nullptr);
+        consumer.join();
+        REQUIRE(consistent);
+    }
+}
+
+TEST_CASE("Messages are handed directly to blocked receivers", "[msgqueue]") {
+    MessageQueue msgQueue;
+    SECTION("Receivers park right away") {}
+    SECTION("Receivers poll before parking") { msgQueue.SetSpinBeforePark(100); }
+    SECTION("Receivers are woken up in FIFO order") { msgQueue.SetWakeOrder(WakeOrder::Fifo); }
+
+    const int receivers = 4;
+    const int rounds = 1000;
+    std::atomic<int> sum(0);
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < receivers; ++i) {
+        threads.emplace_back([&]() {
+            for (int n = 0; n < rounds; ++n) {
+                msgQueue.Receive([&](int, int arg1, int, void*) { sum += arg1; });
+            }
+        });
+    }
+    for (int n = 0; n < receivers * rounds; ++n) {
+        msgQueue.Send(1, n, 0, nullptr);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    REQUIRE(msgQueue.Count() == 0);
+    REQUIRE(sum == receivers * rounds * (receivers * rounds - 1) / 2);
+}
+
+TEST_CASE("A burst queued for a polling receiver is shared with the parked ones", "[msgqueue]") {
+    MessageQueue msgQueue;
+    std::atomic<int> received(0);
+    std::vector<std::thread> threads;
+    auto receiveOne = [&]() { msgQueue.Receive([&](int, int, int, void*) { received++; }); };
+
+    // Two receivers park, then a third one polls the queue while the burst is sent
+    threads.emplace_back(receiveOne);
+    threads.emplace_back(receiveOne);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    msgQueue.SetSpinBeforePark(100000000);
+    threads.emplace_back(receiveOne);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    for (int i = 1; i <= 3; ++i) {
+        msgQueue.Send(1, i, 0, nullptr);
+    }
+
+    for (int wait = 0; wait < 200 && received < 3; ++wait) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK(received == 3);
+    CHECK(msgQueue.Count() == 0);
+
+    // Unblocks the receivers left behind if the test failed
+    for (int i = received; i < 3; ++i) {
+        msgQueue.Send(2, 0, 0, nullptr);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+TEST_CASE("Messages can be consumed as a range until the queue is closed", "[msgqueue]") {
+    MessageQueue msgQueue;
+
+    SECTION("Messages are taken in batches and the range ends once closed and empty") {
+        for (int i = 0; i < 10; ++i) {
+            msgQueue.Send(1, i, 0, nullptr);
+        }
+        msgQueue.Close();
+
+        std::vector<int> received;
+        for (Message& msg : msgQueue.Consume(3)) {
+            received.push_back(msg.arg1);
+        }
+        REQUIRE(received.size() == 10);
+        for (int i = 0; i < 10; ++i) {
+            REQUIRE(received[i] == i);
+        }
+    }
+
+    SECTION("A range waiting on an empty queue ends when it is closed") {
+        std::atomic<int> received(0);
+        std::thread consumer([&]() {
+            for (Message& msg : msgQueue.Consume()) {
+                received += msg.arg1;
+            }
+        });
+        msgQueue.Send(1, 5, 0, nullptr);
+        msgQueue.Send(1, 7, 0, nullptr);
+        msgQueue.Close();
+        consumer.join();
+        REQUIRE(received == 12);
+    }
+
+    SECTION("Filter and Transform are applied lazily") {
+        for (int i = 0; i < 10; ++i) {
+            msgQueue.Send(i % 2, i, 0, nullptr);
+        }
+        int transformed = 0;
+        int total = 0;
+        auto odd = [](const Message& msg) { return msg.what == 1; };
+        auto square = [&](const Message& msg) {
+            transformed++;
+            return msg.arg1 * msg.arg1;
+        };
+        for (int value : msgQueue.Consume().Filter(odd).Transform(square)) {
+            total += value;
+            if (value == 49) {
+                break;
+            }
+        }
+        REQUIRE(transformed == 4);
+        REQUIRE(total == 1 + 9 + 25 + 49);
+
+        // Messages after the last one handed out are left in the queue, in order
+        REQUIRE(msgQueue.Count() == 2);
+        msgQueue.Receive([](int, int arg1, int, void*) { REQUIRE(arg1 == 8); });
+        msgQueue.Receive([](int, int arg1, int, void*) { REQUIRE(arg1 == 9); });
+    }
+
+    SECTION("Calls are answered through the current message") {
+        CallFuture answered = msgQueue.Call(1, 0, 0, nullptr);
+        CallFuture ignored = msgQueue.Call(2, 0, 0, nullptr);
+        msgQueue.Close();
+        for (Message& msg : msgQueue.Consume()) {
+            if (msg.what == 1) {
+                Reply reply(msg);
+                reply.Send(10, 0, 0, nullptr);
+            }
+        }
+        REQUIRE(answered.Get([](int what, int, int, void*) { REQUIRE(what == 10); }));
+        REQUIRE_FALSE(ignored.Get([](int, int, int, void*) {}));
+    }
+
+    SECTION("A batch stops at a barrier") {
+        msgQueue.Send(1, 0, 0, nullptr);
+        CallFuture flushed = msgQueue.Flush();
+        msgQueue.Send(2, 0, 0, nullptr);
+        msgQueue.Close();
+        for (Message& msg : msgQueue.Consume()) {
+            REQUIRE(flushed.Ready() == (msg.what == 2));
+        }
+        REQUIRE(flushed.Ready());
+    }
+
+    SECTION("Messages left in the queue keep their SendLatest and SendTracked indexes") {
+        msgQueue.Send(1, 0, 0, nullptr);
+        msgQueue.SendLatest(2, 7, 1, nullptr);
+        MessageHandle handle = msgQueue.SendTracked(3, 0, 0, nullptr);
+        msgQueue.Send(4, 0, 0, nullptr);
+        for (Message& msg : msgQueue.Consume()) {
+            REQUIRE(msg.what == 1);
+            break;
+        }
+
+        // Still conflated with the pending message
+        msgQueue.SendLatest(2, 7, 2, nullptr);
+        REQUIRE(msgQueue.Count() == 3);
+        REQUIRE(msgQueue.Update(handle, 5, 0, nullptr));
+
+        msgQueue.Receive([](int what, int, int arg2, void*) {
+            REQUIRE(what == 2);
+            REQUIRE(arg2 == 2);
+        });
+        msgQueue.Receive([](int what, int arg1, int, void*) {
+            REQUIRE(what == 3);
+            REQUIRE(arg1 == 5);
+        });
+        REQUIRE(msgQueue.Count() == 1);
+    }
+
+    SECTION("Several consumers share the messages") {
+        const int consumers = 4;
+        const int messages = 10000;
+        std::atomic<int> count(0);
+        std::atomic<long> sum(0);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < consumers; ++i) {
+            threads.emplace_back([&]() {
+                for (Message& msg : msgQueue.Consume(16)) {
+                    count++;
+                    sum += msg.arg1;
+                }
+            });
+        }
+        for (int n = 0; n < messages; ++n) {
+            msgQueue.Send(1, n, 0, nullptr);
+        }
+        msgQueue.Close();
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        REQUIRE(count == messages);
+        REQUIRE(sum == static_cast<long>(messages) * (messages - 1) / 2);
+    }
+}
+
+TEST_CASE("Messages can be answered through the reply of a call", "[msgqueue]") {
+    MessageQueue msgQueue;
+
+    SECTION("A consumer taking a Reply can answer the call") {
+        CallFuture future = msgQueue.Call(1, 2, 3, nullptr);
+        REQUIRE_FALSE(future.Ready());
+
+        msgQueue.Receive([](int what, int arg1, int arg2, void*, Reply& reply) {
+            REQUIRE(reply.Expected());
+            reply.Send(what, arg1 + arg2, 0, nullptr);
+        });
+
+        REQUIRE(future.Ready());
+        REQUIRE(future.Get([](int what, int arg1, int, void*) {
+            REQUIRE(what == 1);
+            REQUIRE(arg1 == 5);
+        }));
+    }
+
+    SECTION("Messages posted with Send do not expect an answer") {
+        msgQueue.Send(1, 2, 3, nullptr);
+        msgQueue.Receive([](int, int, int, void*, Reply& reply) { REQUIRE_FALSE(reply.Expected()); });
+    }
+
+    SECTION("Calls that are not answered are abandoned") {
+        CallFuture received = msgQueue.Call(1, 0, 0, nullptr);
+        CallFuture cleared = msgQueue.Call(2, 0, 0, nullptr);
+
+        msgQueue.Receive([](int, int, int, void*) {});
+        msgQueue.ClearMsgType(2);
+
+        REQUIRE_FALSE(received.Get([](int, int, int, void*) { FAIL("No answer expected"); }));
+        REQUIRE_FALSE(cleared.Get([](int, int, int, void*) { FAIL("No answer expected"); }));
+    }
+
+    SECTION("Futures outlive the queue that created them") {
+        std::unique_ptr<MessageQueue> tempQueue(new MessageQueue());
+        CallFuture future = tempQueue->Call(1, 0, 0, nullptr);
+        tempQueue.reset();
+        REQUIRE(future.Ready());
+        REQUIRE_FALSE(future.Get([](int, int, int, void*) {}));
+    }
+}
+
+TEST_CASE("Calls can be answered by another thread", "[msgqueue]") {
+    const int calls = 10000;
+    MessageQueue msgQueue;
+
+    std::thread server([&msgQueue]() {
+        for (int i = 0; i < calls; ++i) {
+            msgQueue.Receive([](int what, int arg1, int arg2, void*, Reply& reply) {
+                reply.Send(what, arg1 * arg2, 0, nullptr);
+            });
+        }
+    });
+
+    // More calls than reply slots, so the slots must be recycled
+    long long sum = 0;
+    for (int i = 0; i < calls; ++i) {
+        CallFuture future = msgQueue.Call(1, i, 2, nullptr);
+        future.Get([&sum](int, int arg1, int, void*) { sum += arg1; });
+    }
+    server.join();
+
+    REQUIRE(sum == static_cast<long long>(calls) * (calls - 1));
+}
+
 static const int Total = 10000000;
 
 static const int Add = 1;
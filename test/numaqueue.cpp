@@ -0,0 +1,146 @@
+#include "catch.hpp"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <list>
+#include <string>
+#include <vector>
+#include "NodeArena.hpp"
+#include "NumaMessageQueue.hpp"
+#include "NumaTopology.hpp"
+
+using namespace libmsgpass;
+
+// Fake sysfs node directory with the given cpu lists, for nodes 0, 1... unless other ids are
+// given. The directory is removed with the object.
+class FakeNodes {
+   public:
+    explicit FakeNodes(const std::vector<std::string>& cpuLists,
+                       const std::vector<int>& ids = {}) {
+        char path[] = "/tmp/msgpass-numa-XXXXXX";
+        root_ = mkdtemp(path);
+        for (size_t i = 0; i < cpuLists.size(); ++i) {
+            int id = ids.empty() ? static_cast<int>(i) : ids[i];
+            std::string nodeDir = root_ + "/node" + std::to_string(id);
+            mkdir(nodeDir.c_str(), 0755);
+            std::ofstream(nodeDir + "/cpulist") << cpuLists[i] << "\n";
+            node_dirs_.push_back(nodeDir);
+        }
+    }
+    FakeNodes(const FakeNodes&) = delete;
+
+    ~FakeNodes() {
+        for (const std::string& nodeDir : node_dirs_) {
+            unlink((nodeDir + "/cpulist").c_str());
+            rmdir(nodeDir.c_str());
+        }
+        rmdir(root_.c_str());
+    }
+
+    const std::string& Path() const { return root_; }
+
+   private:
+    std::string root_;
+    std::vector<std::string> node_dirs_;
+};
+
+TEST_CASE("Cpu lists in the kernel format can be parsed", "[numa]") {
+    REQUIRE(NumaTopology::ParseCpuList("0") == std::vector<int>{0});
+    REQUIRE(NumaTopology::ParseCpuList("0-3,8,10-11\n") ==
+            std::vector<int>({0, 1, 2, 3, 8, 10, 11}));
+    REQUIRE(NumaTopology::ParseCpuList("").empty());
+}
+
+TEST_CASE("NUMA topology is read from sysfs", "[numa]") {
+    SECTION("Each node directory describes its CPUs") {
+        FakeNodes nodes({"0-1,4-5", "2-3,6-7"});
+        NumaTopology topology(nodes.Path());
+        REQUIRE(topology.NodeCount() == 2);
+        REQUIRE(topology.NodeCpus(1) == std::vector<int>({2, 3, 6, 7}));
+        REQUIRE(topology.NodeOfCpu(5) == 0);
+        REQUIRE(topology.NodeOfCpu(6) == 1);
+        REQUIRE(topology.NodeOfCpu(100) == 0);
+    }
+
+    SECTION("Node ids may not be contiguous") {
+        FakeNodes nodes({"0-1", "2-3"}, {0, 2});
+        NumaTopology topology(nodes.Path());
+        REQUIRE(topology.NodeCount() == 2);
+        REQUIRE(topology.NodeId(0) == 0);
+        REQUIRE(topology.NodeId(1) == 2);
+        REQUIRE(topology.NodeOfCpu(3) == 1);
+    }
+
+    SECTION("Machines without NUMA information have a single node") {
+        NumaTopology topology("/nonexistent");
+        REQUIRE(topology.NodeCount() == 1);
+        REQUIRE_FALSE(topology.NodeCpus(0).empty());
+    }
+}
+
+TEST_CASE("NUMA queue can send and receive", "[numa]") {
+    FakeNodes nodes({"0-1", "2-3"});
+    NumaTopology topology(nodes.Path());
+    NumaMessageQueue msgQueue(topology);
+    REQUIRE(msgQueue.NodeCount() == 2);
+
+    SECTION("Messages sent to a remote node are stolen when the local node is empty") {
+        msgQueue.SendToNode(0, 1, 1, 1, nullptr);
+        msgQueue.SendToNode(1, 2, 2, 2, nullptr);
+        REQUIRE(msgQueue.Count() == 2);
+
+        int received = 0;
+        msgQueue.Receive([&](int what, int arg1, int, void*) { received += what * arg1; });
+        msgQueue.Receive([&](int what, int arg1, int, void*) { received += what * arg1; });
+        REQUIRE(received == 5);
+        REQUIRE(msgQueue.Count() == 0);
+        REQUIRE_FALSE(msgQueue.TryReceive([](int, int, int, void*) {}));
+    }
+
+    SECTION("Messages are stored in the arena of their node") {
+        msgQueue.SendToNode(1, 1, 0, 0, nullptr);
+        msgQueue.SendToNode(1, 2, 0, 0, nullptr);
+        REQUIRE(msgQueue.Arena(0).InUse() == 0);
+        REQUIRE(msgQueue.Arena(1).InUse() == 2);
+
+        msgQueue.Receive([](int, int, int, void*) {});
+        msgQueue.Receive([](int, int, int, void*) {});
+        REQUIRE(msgQueue.Arena(1).InUse() == 0);
+    }
+
+    SECTION("Messages with a specific 'what' are removed from all the nodes") {
+        msgQueue.SendToNode(0, 1, 0, 0, nullptr);
+        msgQueue.SendToNode(1, 1, 0, 0, nullptr);
+        msgQueue.Send(2, 0, 0, nullptr);
+        REQUIRE(msgQueue.ClearMsgType(1) == 2);
+        REQUIRE(msgQueue.Count() == 1);
+    }
+}
+
+TEST_CASE("Node arenas serve the blocks of a container", "[numa]") {
+    NodeArena arena(0);
+    NodeArena other(0);
+    std::list<Message, NodeArenaAllocator<Message>> messages{NodeArenaAllocator<Message>(arena)};
+    for (int i = 0; i < 1000; ++i) {
+        messages.push_back(Message());
+    }
+    REQUIRE(arena.InUse() == 1000);
+    for (Message& message : messages) {
+        REQUIRE(arena.Owns(&message));
+        REQUIRE_FALSE(other.Owns(&message));
+    }
+
+    // Released blocks are reused
+    void* block = arena.Allocate(40);
+    arena.Deallocate(block, 40);
+    REQUIRE(arena.Allocate(40) == block);
+    arena.Deallocate(block, 40);
+
+    REQUIRE(NodeArenaAllocator<Message>(arena) == NodeArenaAllocator<int>(arena));
+    REQUIRE(NodeArenaAllocator<Message>(arena) != NodeArenaAllocator<Message>(other));
+    messages.clear();
+    REQUIRE(arena.InUse() == 0);
+}
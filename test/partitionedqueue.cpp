@@ -0,0 +1,91 @@
+#include "catch.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "PartitionedQueue.hpp"
+
+using namespace libmsgpass;
+
+TEST_CASE("Partitioned queue can send and receive", "[partitioned]") {
+    PartitionedQueue msgQueue(4);
+    REQUIRE(msgQueue.LaneCount() == 4);
+
+    msgQueue.Send(1, 2, 3, &msgQueue);
+    REQUIRE(msgQueue.Count() == 1);
+    msgQueue.Receive([&](int what, int arg1, int arg2, void* obj) {
+        REQUIRE(what == 1);
+        REQUIRE(arg1 == 2);
+        REQUIRE(arg2 == 3);
+        REQUIRE(obj == &msgQueue);
+    });
+    REQUIRE(msgQueue.Count() == 0);
+}
+
+TEST_CASE("Messages with the same key are received in order", "[partitioned]") {
+    PartitionedQueue msgQueue(3, [](int, int, int arg2, void*) { return static_cast<size_t>(arg2); });
+
+    for (int i = 0; i < 30; ++i) {
+        msgQueue.Send(0, i, i % 5, nullptr);
+    }
+
+    std::vector<int> last(5, -1);
+    bool ordered = true;
+    for (int i = 0; i < 30; ++i) {
+        msgQueue.Receive([&](int, int arg1, int arg2, void*) {
+            ordered = ordered && arg1 > last[arg2];
+            last[arg2] = arg1;
+        });
+    }
+    REQUIRE(ordered);
+    REQUIRE(msgQueue.Count() == 0);
+
+    SECTION("Batches only contain messages from one lane") {
+        msgQueue.Send(0, 0, 1, nullptr);
+        msgQueue.Send(0, 1, 1, nullptr);
+        msgQueue.Send(0, 2, 1, nullptr);
+        REQUIRE(msgQueue.ReceiveBatch([](int, int, int arg2, void*) { REQUIRE(arg2 == 1); }, 2) == 2);
+        REQUIRE(msgQueue.ReceiveBatch([](int, int, int, void*) {}, 2) == 1);
+    }
+}
+
+TEST_CASE("Each key is processed by one consumer at a time", "[partitioned]") {
+    const int keys = 16;
+    const int perKey = 5000;
+    const int consumers = 4;
+    PartitionedQueue msgQueue(8);
+    std::vector<std::atomic<int>> busy(keys);
+    std::vector<int> next(keys, 0);
+    std::atomic<int> errors(0);
+    std::vector<std::thread> threads;
+
+    for (int c = 0; c < consumers; ++c) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < keys * perKey / consumers; ++i) {
+                msgQueue.Receive([&](int, int key, int seq, void*) {
+                    if (busy[key].exchange(1) != 0) {
+                        errors++;
+                    }
+                    // Unsynchronized on purpose, the lane guarantees exclusive access to the key
+                    if (next[key] != seq) {
+                        errors++;
+                    }
+                    next[key] = seq + 1;
+                    busy[key].store(0);
+                });
+            }
+        });
+    }
+
+    for (int seq = 0; seq < perKey; ++seq) {
+        for (int key = 0; key < keys; ++key) {
+            msgQueue.Send(0, key, seq, nullptr);
+        }
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(errors == 0);
+    REQUIRE(msgQueue.Count() == 0);
+}
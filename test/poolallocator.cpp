@@ -0,0 +1,75 @@
+#include "catch.hpp"
+
+#include <list>
+#include <thread>
+#include <vector>
+#include "MessageQueue.hpp"
+#include "PoolAllocator.hpp"
+
+using namespace libmsgpass;
+
+TEST_CASE("Pool recycles released blocks", "[pool]") {
+    PoolStats before = NodePool::Stats();
+
+    void* first = NodePool::Allocate(40);
+    NodePool::Deallocate(first, 40);
+    void* second = NodePool::Allocate(40);
+    NodePool::Deallocate(second, 40);
+
+    PoolStats after = NodePool::Stats();
+    REQUIRE(first == second);
+    REQUIRE(after.allocations - before.allocations == 2);
+    REQUIRE(after.reused - before.reused >= 1);
+}
+
+TEST_CASE("Blocks released by other threads are reused", "[pool]") {
+    const int count = 10000;
+    std::vector<void*> blocks;
+    for (int i = 0; i < count; ++i) {
+        blocks.push_back(NodePool::Allocate(24));
+    }
+
+    // Released in another thread, which hands them back to the depot when it exits
+    std::thread releaser([&blocks]() {
+        for (void* block : blocks) {
+            NodePool::Deallocate(block, 24);
+        }
+    });
+    releaser.join();
+
+    PoolStats before = NodePool::Stats();
+    for (int i = 0; i < count; ++i) {
+        blocks[i] = NodePool::Allocate(24);
+    }
+    PoolStats after = NodePool::Stats();
+    for (void* block : blocks) {
+        NodePool::Deallocate(block, 24);
+    }
+
+    REQUIRE(after.reused - before.reused == count);
+}
+
+TEST_CASE("Pool allocator can be used with standard containers", "[pool]") {
+    std::list<int, PoolAllocator<int>> values;
+    for (int i = 0; i < 1000; ++i) {
+        values.push_back(i);
+    }
+    values.clear();
+    for (int i = 0; i < 1000; ++i) {
+        values.push_back(i);
+    }
+    REQUIRE(values.size() == 1000);
+    REQUIRE(values.back() == 999);
+}
+
+TEST_CASE("Message queue can use other allocators", "[pool]") {
+    BasicMessageQueue<std::allocator<Message>> msgQueue;
+    msgQueue.Send(1, 2, 3, nullptr);
+    REQUIRE(msgQueue.Count() == 1);
+    msgQueue.Receive([](int what, int arg1, int arg2, void*) {
+        REQUIRE(what == 1);
+        REQUIRE(arg1 == 2);
+        REQUIRE(arg2 == 3);
+    });
+    REQUIRE(msgQueue.Count() == 0);
+}
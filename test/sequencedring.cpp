@@ -0,0 +1,120 @@
+#include "catch.hpp"
+
+#include <thread>
+#include <vector>
+#include "SequencedRing.hpp"
+
+using namespace libmsgpass;
+
+struct Event {
+    int value;
+    int decoded;
+    int enriched;
+};
+
+TEST_CASE("Published entries are processed by a stage in place", "[ring]") {
+    SequencedRing<Event> ring(4);
+    RingStage<Event> stage(ring);
+    ring.AddGatingSequence(stage.Position());
+    REQUIRE(ring.Capacity() == 4);
+
+    REQUIRE(stage.TryProcess([](Event&, int64_t) {}) == 0);
+
+    ring.Publish([](Event& event) { event.value = 1; });
+    ring.Publish([](Event& event) { event.value = 2; });
+
+    std::vector<int> values;
+    REQUIRE(stage.Process([&](Event& event, int64_t sequence) {
+        values.push_back(event.value);
+        event.value = static_cast<int>(sequence) * 10;
+    }) == 2);
+    REQUIRE(values == std::vector<int>({1, 2}));
+    REQUIRE(stage.Position().Get() == 1);
+    REQUIRE(ring[1].value == 10);
+}
+
+TEST_CASE("Stages only see entries after the stages they depend on", "[ring]") {
+    SequencedRing<Event> ring(8);
+    RingStage<Event> decode(ring);
+    RingStage<Event> enrich(ring, {&decode.Position()});
+    ring.AddGatingSequence(enrich.Position());
+
+    ring.Publish([](Event& event) { event.value = 3; });
+    REQUIRE(enrich.TryProcess([](Event&, int64_t) {}) == 0);
+
+    REQUIRE(decode.Process([](Event& event, int64_t) { event.decoded = event.value * 2; }) == 1);
+    REQUIRE(enrich.Process([](Event& event, int64_t) {
+        REQUIRE(event.decoded == 6);
+        event.enriched = event.decoded + 1;
+    }) == 1);
+    REQUIRE(ring[0].enriched == 7);
+}
+
+// Every event carries its own sequence, so each stage can check that it sees them in order
+static void RunPipeline(RingWait wait) {
+    const int64_t events = 200000;
+    const int producers = 2;
+    SequencedRing<Event> ring(64, wait);
+    RingStage<Event> decode(ring);
+    RingStage<Event> enrich(ring, {&decode.Position()});
+    RingStage<Event> persist(ring, {&enrich.Position()});
+    ring.AddGatingSequence(persist.Position());
+
+    long long decodeErrors = 0;
+    long long enrichErrors = 0;
+    long long persistErrors = 0;
+    long long persisted = 0;
+    std::vector<std::thread> threads;
+
+    threads.emplace_back([&]() {
+        int expected = 0;
+        while (decode.Position().Get() < events - 1) {
+            decode.Process([&](Event& event, int64_t) {
+                decodeErrors += event.value != expected++;
+                event.decoded = event.value + 1;
+            });
+        }
+    });
+    threads.emplace_back([&]() {
+        int expected = 0;
+        while (enrich.Position().Get() < events - 1) {
+            enrich.Process([&](Event& event, int64_t) {
+                enrichErrors += event.value != expected++ || event.decoded != event.value + 1;
+                event.enriched = event.decoded * 2;
+            });
+        }
+    });
+    threads.emplace_back([&]() {
+        int expected = 0;
+        while (persist.Position().Get() < events - 1) {
+            persist.Process([&](Event& event, int64_t) {
+                persistErrors +=
+                    event.value != expected++ || event.enriched != (event.value + 1) * 2;
+                persisted++;
+            });
+        }
+    });
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&]() {
+            for (int64_t i = 0; i < events / producers; ++i) {
+                int64_t sequence = ring.Next();
+                ring[sequence].value = static_cast<int>(sequence);
+                ring.Publish(sequence);
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    REQUIRE(decodeErrors == 0);
+    REQUIRE(enrichErrors == 0);
+    REQUIRE(persistErrors == 0);
+    REQUIRE(persisted == events);
+}
+
+TEST_CASE("A pipeline of stages processes every event in order", "[ring]") {
+    SECTION("Blocking wait") { RunPipeline(RingWait::Blocking); }
+    SECTION("Yielding wait") { RunPipeline(RingWait::Yielding); }
+}
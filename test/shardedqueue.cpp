@@ -0,0 +1,132 @@
+#include "catch.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "ShardedMessageQueue.hpp"
+
+using namespace libmsgpass;
+
+TEST_CASE("Sharded queue can send and receive", "[shardedqueue]") {
+    ShardedMessageQueue msgQueue(4);
+
+    REQUIRE(msgQueue.ShardCount() == 4);
+    REQUIRE(msgQueue.Count() == 0);
+    REQUIRE_FALSE(msgQueue.TryReceive([](int, int, int, void*) {}));
+
+    msgQueue.Send(1, 2, 3, &msgQueue);
+    REQUIRE(msgQueue.Count() == 1);
+
+    msgQueue.Receive([&](int what, int arg1, int arg2, void* obj) {
+        REQUIRE(what == 1);
+        REQUIRE(arg1 == 2);
+        REQUIRE(arg2 == 3);
+        REQUIRE(obj == &msgQueue);
+    });
+    REQUIRE(msgQueue.Count() == 0);
+}
+
+TEST_CASE("Messages with a specific 'what' can be removed from all the shards", "[shardedqueue]") {
+    ShardedMessageQueue msgQueue(4, ShardedMessageQueue::Ordering::Balanced);
+
+    for (int i = 0; i < 12; ++i) {
+        msgQueue.Send(i % 3, i, i, nullptr);
+    }
+
+    REQUIRE(msgQueue.ClearMsgType(1) == 4);
+    REQUIRE(msgQueue.Count() == 8);
+    while (msgQueue.TryReceive([](int what, int, int, void*) { REQUIRE(what != 1); })) {
+    }
+    REQUIRE(msgQueue.Count() == 0);
+}
+
+TEST_CASE("Sharded queue keeps the order of each producer", "[shardedqueue]") {
+    const int producers = 4;
+    const int perProducer = 10000;
+    ShardedMessageQueue msgQueue(3, ShardedMessageQueue::Ordering::PerProducer);
+    std::vector<std::thread> threads;
+
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&msgQueue, p]() {
+            for (int i = 0; i < perProducer; ++i) {
+                msgQueue.Send(0, p, i, nullptr);
+            }
+        });
+    }
+
+    // A single consumer must see the messages of each producer in sequence
+    std::vector<int> next(producers, 0);
+    bool ordered = true;
+    for (int i = 0; i < producers * perProducer; ++i) {
+        msgQueue.Receive([&](int, int producer, int seq, void*) {
+            ordered = ordered && (next[producer] == seq);
+            next[producer] = seq + 1;
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    REQUIRE(ordered);
+    REQUIRE(msgQueue.Count() == 0);
+}
+
+TEST_CASE("Multiple threads can communicate using the sharded queue", "[shardedqueue]") {
+    const int threadCount = 4;
+    const int perThread = 100000;
+    ShardedMessageQueue msgQueue(threadCount, ShardedMessageQueue::Ordering::Balanced);
+    std::atomic<long long> sum(0);
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&msgQueue]() {
+            for (int i = 1; i <= perThread; ++i) {
+                msgQueue.Send(0, i, 0, nullptr);
+            }
+        });
+        threads.emplace_back([&msgQueue, &sum]() {
+            for (int i = 0; i < perThread; ++i) {
+                msgQueue.Receive([&](int, int arg1, int, void*) { sum += arg1; });
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    REQUIRE(sum == threadCount * (static_cast<long long>(perThread) * (perThread + 1) / 2));
+    REQUIRE(msgQueue.Count() == 0);
+}
+
+TEST_CASE("Count stays in range while messages are taken before being counted", "[shardedqueue]") {
+    const int messages = 200000;
+    ShardedMessageQueue msgQueue(2);
+    std::atomic<bool> running(true);
+    std::atomic<size_t> highest(0);
+
+    std::thread sampler([&]() {
+        while (running) {
+            size_t count = msgQueue.Count();
+            if (count > highest) {
+                highest = count;
+            }
+        }
+    });
+    std::thread consumer([&]() {
+        for (int i = 0; i < messages; ++i) {
+            while (!msgQueue.TryReceive([](int, int, int, void*) {})) {
+            }
+        }
+    });
+    for (int i = 0; i < messages; ++i) {
+        msgQueue.Send(0, i, 0, nullptr);
+    }
+    consumer.join();
+    running = false;
+    sampler.join();
+
+    REQUIRE(highest <= static_cast<size_t>(messages));
+    REQUIRE(msgQueue.Count() == 0);
+}
@@ -0,0 +1,73 @@
+#include "catch.hpp"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "Strand.hpp"
+#include "ThreadPool.hpp"
+
+using namespace libmsgpass;
+
+struct Account {
+    std::atomic<int> running;
+    int next;
+    int errors;
+
+    Account() : running(0), next(0), errors(0) {}
+};
+
+TEST_CASE("Strand messages are handled one at a time and in order", "[strand]") {
+    const int accounts = 32;
+    const int producers = 4;
+    const int perProducer = 2000;
+    std::vector<std::unique_ptr<Account>> state;
+    std::vector<std::unique_ptr<Strand>> strands;
+    std::atomic<int> handled(0);
+
+    {
+        ThreadPool pool(4);
+        for (int a = 0; a < accounts; ++a) {
+            state.emplace_back(new Account());
+            Account* account = state.back().get();
+            strands.emplace_back(new Strand(pool, [account, &handled](int, int, int seq, void*) {
+                if (account->running.exchange(1) != 0) {
+                    account->errors++;
+                }
+                // Each producer sends its own sequence to a different account
+                if (account->next != seq) {
+                    account->errors++;
+                }
+                account->next = seq + 1;
+                account->running.store(0);
+                handled++;
+            }));
+        }
+
+        std::vector<std::thread> threads;
+        for (int p = 0; p < producers; ++p) {
+            threads.emplace_back([&, p]() {
+                for (int seq = 0; seq < perProducer; ++seq) {
+                    for (int a = p; a < accounts; a += producers) {
+                        strands[a]->Send(0, a, seq, nullptr);
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        while (handled.load() < accounts * perProducer) {
+            std::this_thread::yield();
+        }
+    }
+
+    for (auto& account : state) {
+        REQUIRE(account->errors == 0);
+        REQUIRE(account->next == perProducer);
+    }
+    for (auto& strand : strands) {
+        REQUIRE(strand->Count() == 0);
+    }
+}
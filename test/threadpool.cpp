@@ -0,0 +1,120 @@
+#include "catch.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "ThreadPool.hpp"
+#include "WorkStealingDeque.hpp"
+
+using namespace libmsgpass;
+
+TEST_CASE("Work stealing deque is LIFO for the owner and FIFO for thieves", "[threadpool]") {
+    WorkStealingDeque<int*> deque(3);
+    int values[5] = {0, 1, 2, 3, 4};
+    int* item = nullptr;
+
+    REQUIRE(deque.Empty());
+    REQUIRE_FALSE(deque.Pop(item));
+    REQUIRE_FALSE(deque.Steal(item));
+
+    for (int i = 0; i < 4; ++i) {
+        REQUIRE(deque.Push(&values[i]));
+    }
+    REQUIRE_FALSE(deque.Push(&values[4]));
+
+    REQUIRE(deque.Pop(item));
+    REQUIRE(item == &values[3]);
+    REQUIRE(deque.Steal(item));
+    REQUIRE(item == &values[0]);
+    REQUIRE(deque.Pop(item));
+    REQUIRE(item == &values[2]);
+    REQUIRE(deque.Pop(item));
+    REQUIRE(item == &values[1]);
+    REQUIRE(deque.Empty());
+}
+
+TEST_CASE("Every item of a work stealing deque is taken once", "[threadpool]") {
+    const int items = 100000;
+    WorkStealingDeque<intptr_t> deque(items);
+    std::atomic<long long> stolen(0);
+    std::atomic<bool> done(false);
+    std::vector<std::thread> thieves;
+
+    for (int t = 0; t < 3; ++t) {
+        thieves.emplace_back([&]() {
+            intptr_t item;
+            while (!done.load() || !deque.Empty()) {
+                if (deque.Steal(item)) {
+                    stolen += item;
+                }
+            }
+        });
+    }
+
+    long long popped = 0;
+    intptr_t item;
+    for (intptr_t i = 1; i <= items; ++i) {
+        deque.Push(i);
+        if (i % 3 == 0 && deque.Pop(item)) {
+            popped += item;
+        }
+    }
+    while (deque.Pop(item)) {
+        popped += item;
+    }
+    done = true;
+
+    for (auto& thread : thieves) {
+        thread.join();
+    }
+    REQUIRE(popped + stolen == static_cast<long long>(items) * (items + 1) / 2);
+}
+
+TEST_CASE("Thread pool runs every submitted task", "[threadpool]") {
+    const int tasks = 100000;
+    std::atomic<int> executed(0);
+
+    SECTION("Tasks submitted from outside the pool") {
+        ThreadPool pool(4);
+        REQUIRE(pool.ThreadCount() == 4);
+        for (int i = 0; i < tasks; ++i) {
+            pool.Submit([&executed]() { executed++; });
+        }
+    }
+
+    SECTION("Tasks submitted by other tasks") {
+        ThreadPool pool(4);
+        for (int i = 0; i < tasks / 100; ++i) {
+            pool.Submit([&executed, &pool]() {
+                for (int j = 0; j < 99; ++j) {
+                    pool.Submit([&executed]() { executed++; });
+                }
+                executed++;
+            });
+        }
+    }
+
+    SECTION("Tasks submitted while the pool is stopping") {
+        std::atomic<bool> started(false);
+        {
+            ThreadPool pool(1);
+            pool.Submit([&]() {
+                started = true;
+                // Let the destructor queue the stop request first
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                // More than the local deque holds, the rest goes to the injection queue
+                for (int i = 0; i < tasks - 1; ++i) {
+                    pool.Submit([&executed]() { executed++; });
+                }
+                executed++;
+            });
+            while (!started) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // The pool was destroyed after running all the tasks
+    REQUIRE(executed == tasks);
+}
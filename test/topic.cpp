@@ -0,0 +1,91 @@
+#include "catch.hpp"
+
+#include <thread>
+#include <vector>
+#include "Topic.hpp"
+
+using namespace libmsgpass;
+
+TEST_CASE("Every subscriber receives every published message", "[topic]") {
+    Topic topic(8);
+    Topic::Subscriber first(topic);
+    Topic::Subscriber second(topic);
+
+    topic.Publish(1, 2, 3, &topic);
+    topic.Publish(4, 5, 6, nullptr);
+    REQUIRE(topic.Published() == 2);
+
+    for (Topic::Subscriber* subscriber : {&first, &second}) {
+        REQUIRE(subscriber->Count() == 2);
+        subscriber->Receive([&](int what, int arg1, int arg2, void* obj) {
+            REQUIRE(what == 1);
+            REQUIRE(arg1 == 2);
+            REQUIRE(arg2 == 3);
+            REQUIRE(obj == &topic);
+        });
+        REQUIRE(subscriber->TryReceive([](int what, int, int, void*) { REQUIRE(what == 4); }));
+        REQUIRE_FALSE(subscriber->TryReceive([](int, int, int, void*) {}));
+        REQUIRE(subscriber->Lost() == 0);
+    }
+
+    SECTION("Subscribers only see messages published after they subscribed") {
+        Topic::Subscriber late(topic);
+        REQUIRE(late.Count() == 0);
+        topic.Publish(7, 0, 0, nullptr);
+        REQUIRE(late.TryReceive([](int what, int, int, void*) { REQUIRE(what == 7); }));
+    }
+}
+
+TEST_CASE("Slow subscribers skip overwritten messages", "[topic]") {
+    Topic topic(5, Topic::LagPolicy::DropOldest);
+    Topic::Subscriber subscriber(topic);
+    REQUIRE(topic.Capacity() == 8);
+
+    for (int i = 0; i < 20; ++i) {
+        topic.Publish(i, 0, 0, nullptr);
+    }
+
+    // Only the last ring worth of messages is still available
+    std::vector<int> received;
+    while (subscriber.TryReceive([&](int what, int, int, void*) { received.push_back(what); })) {
+    }
+    REQUIRE(received.size() == 8);
+    REQUIRE(received.front() == 12);
+    REQUIRE(received.back() == 19);
+    REQUIRE(subscriber.Lost() == 12);
+}
+
+TEST_CASE("Publishers wait for slow subscribers when blocking", "[topic]") {
+    const int messages = 100000;
+    Topic topic(16, Topic::LagPolicy::Block);
+    std::vector<long long> sums(4, 0);
+    std::vector<uint64_t> lost(4, 0);
+    std::vector<std::thread> threads;
+    std::atomic<int> subscribed(0);
+
+    for (size_t s = 0; s < sums.size(); ++s) {
+        threads.emplace_back([&, s]() {
+            Topic::Subscriber subscriber(topic);
+            subscribed++;
+            for (int i = 0; i < messages; ++i) {
+                subscriber.Receive([&](int, int arg1, int, void*) { sums[s] += arg1; });
+            }
+            lost[s] = subscriber.Lost();
+        });
+    }
+
+    while (subscribed.load() < static_cast<int>(sums.size())) {
+        std::this_thread::yield();
+    }
+    for (int i = 0; i < messages; ++i) {
+        topic.Publish(0, i, 0, nullptr);
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (size_t s = 0; s < sums.size(); ++s) {
+        REQUIRE(sums[s] == static_cast<long long>(messages) * (messages - 1) / 2);
+        REQUIRE(lost[s] == 0);
+    }
+}